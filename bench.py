@@ -1,17 +1,19 @@
 #!/usr/bin/env python3
 
-# Note that this script requires setting up numpy / scipy yourself.
+# Note that this script requires setting up numpy / scipy yourself, except
+# for --matrix.
 
 import argparse
 from enum import Enum
 import math
 import os
 from pathlib import Path
+import re
 import signal
 import subprocess
-from typing import List, Tuple
-import numpy as np
-import scipy.stats
+import tempfile
+import time
+from typing import Callable, Dict, List, Optional, Tuple
 
 # 10 min timeout
 TIMEOUT = 600
@@ -35,6 +37,12 @@ def parse_args():
                         help="allocator name, default to \"mymalloc\"")
     parser.add_argument("-i", "--invocations", type=int, default=10,
                         help="number of invocations of the benchmark")
+    parser.add_argument("--matrix", action="store_true",
+                        help="run every workload against every variant and print one table")
+    parser.add_argument("--variants", type=str, default=",".join(MATRIX_VARIANTS),
+                        help="comma separated variants of the matrix")
+    parser.add_argument("-o", "--output", type=str,
+                        help="also write the matrix table to this file")
     return parser.parse_args()
 
 
@@ -138,7 +146,18 @@ def check_test(test: str, output: bytes, exit_code: SubprocessExit, path: Path):
             "UTF-8"), "exit_code": exit_code})
 
 
-def run_benchmark_once(path: str, cwd: Path, i: int) -> Tuple[bytes, float, SubprocessExit]:
+def parse_counters(output: str) -> Dict[str, Dict[str, float]]:
+    """Event counts per op of each workload, from the lines of
+    bench/counters.h: counters <label> <ops> ops  <name> <count> (...) ..."""
+    counters = {}
+    for match in re.finditer(r"^counters (\S+) (\d+) ops(.*)$", output, re.MULTILINE):
+        label, ops, rest = match.group(1), int(match.group(2)), match.group(3)
+        counters[label] = {name: int(count) / ops
+                           for name, count in re.findall(r"(\S+) (\d+) \(", rest) if ops > 0}
+    return counters
+
+
+def run_benchmark_once(path: str, cwd: Path, i: int) -> Tuple[bytes, float, Dict[str, Dict[str, float]], SubprocessExit]:
     try:
         print(f"{bcolors.OKCYAN}Running {bcolors.BOLD}{get_test_name(path)} #{i} {bcolors.ENDC}",
               end='', flush=True)
@@ -151,22 +170,27 @@ def run_benchmark_once(path: str, cwd: Path, i: int) -> Tuple[bytes, float, Subp
             timeout=TIMEOUT,
             cwd=cwd
         )
-        time = float(p.stdout.decode("utf-8").strip())
+        # The time, then the event counts if there are counters
+        output = p.stdout.decode("utf-8")
+        time = float(output.strip().splitlines()[0])
         print(f"{bcolors.OKGREEN}OK ({time:.3f}s){bcolors.ENDC}", flush=True)
-        return p.stdout, time, SubprocessExit.Normal
+        return p.stdout, time, parse_counters(output), SubprocessExit.Normal
     except subprocess.CalledProcessError as e:
         if -e.returncode in signal.valid_signals():
             exit_signal = bytearray(e.stdout)
             exit_signal.extend(
                 bytes(f"{signal.strsignal(-e.returncode)}", "UTF-8"))
             e.stdout = bytes(exit_signal)
-        return e.stdout, -1, SubprocessExit.Error
+        return e.stdout, -1, {}, SubprocessExit.Error
     except subprocess.TimeoutExpired as e:
         out = f"Timed out after {TIMEOUT}s"
-        return bytes(out, "UTF-8"), -1, SubprocessExit.Timeout
+        return bytes(out, "UTF-8"), -1, {}, SubprocessExit.Timeout
 
 
 def calc_mean_with_ci(x: List[float], confidence=0.95) -> Tuple[float, float]:
+    # Only needed here, so --matrix runs without them
+    import numpy as np
+    import scipy.stats
     if len(x) == 1:
         return x[0], 0
     a = 1.0 * np.array(x)
@@ -179,10 +203,15 @@ def calc_mean_with_ci(x: List[float], confidence=0.95) -> Tuple[float, float]:
 def run_benchmark(path: str, invocations: int, cwd: Path):
     print(f"{bcolors.OKCYAN}Start benchmark with {bcolors.ENDC}{bcolors.OKCYAN}{bcolors.BOLD}{invocations}{bcolors.ENDC}{bcolors.OKCYAN} invocations.{bcolors.ENDC}", flush=True)
     times = []
+    # Per op counts of each invocation, by workload and counter
+    counts: Dict[str, Dict[str, List[float]]] = {}
     for i in range(invocations):
-        out, time, exit_code = run_benchmark_once(path, cwd, i)
+        out, time, counters, exit_code = run_benchmark_once(path, cwd, i)
         if exit_code == SubprocessExit.Normal:
             times.append(time)
+            for label, values in counters.items():
+                for name, value in values.items():
+                    counts.setdefault(label, {}).setdefault(name, []).append(value)
         elif exit_code == SubprocessExit.Error:
             print(f"{bcolors.FAIL}FAIL{bcolors.ENDC}", flush=True)
         else:
@@ -197,6 +226,245 @@ def run_benchmark(path: str, invocations: int, cwd: Path):
     else:
         mean, err = calc_mean_with_ci(times)
         print(f"{bcolors.OKGREEN}Average Time: {bcolors.BOLD}{mean:.3f}s ±{err:.3f}{bcolors.ENDC}", flush=True)
+    print_counters(counts)
+
+
+def print_counters(counts: Dict[str, Dict[str, List[float]]]):
+    """Prints the mean event counts per op of each workload, with their 95%
+    confidence intervals, for the counters the machine has."""
+    if not counts:
+        return
+    names = []
+    for values in counts.values():
+        names += [name for name in values if name not in names]
+    rows = []
+    for label, values in counts.items():
+        row = [label]
+        for name in names:
+            if name in values:
+                mean, err = calc_mean_with_ci(values[name])
+                row.append(f"{mean:.4g} ±{err:.2g}")
+            else:
+                row.append("n/a")
+        rows.append(row)
+    header = ["per op"] + names
+    widths = [max(len(row[i]) for row in [header] + rows) for i in range(len(header))]
+    print(f"{bcolors.OKGREEN}Event counts per op:{bcolors.ENDC}")
+    for row in [header] + rows:
+        print("  ".join(c.rjust(w) if i > 0 else c.ljust(w)
+                        for i, (c, w) in enumerate(zip(row, widths))), flush=True)
+
+
+# ===================== Benchmark matrix (--matrix) ===========================
+# Every variant is built as its own library (make MALLOC=<variant> RELEASE=1
+# bench), glibc's malloc through the my_malloc_glibc shim, and each workload
+# is run once against it. Arguments are sized so that every variant can run
+# them (base and optimize cap allocations at 128 MB). Workloads with threads
+# only run on the variants that take locks.
+
+MATRIX_VARIANTS = ["mymalloc", "my_malloc_optimize", "my_malloc_base", "mygc", "my_malloc_glibc"]
+THREAD_SAFE = {"mymalloc", "my_malloc_glibc"}
+# Per workload and variant
+MATRIX_TIMEOUT = 120
+
+
+class Result:
+    def __init__(self, status: str, wall: float = 0, rss_mb: float = 0,
+                 throughput: str = "-", percentiles: Optional[Dict[str, float]] = None):
+        self.status = status
+        self.wall = wall
+        self.rss_mb = rss_mb
+        self.throughput = throughput
+        self.percentiles = percentiles or {}
+
+
+def first_float(pattern: str, out: str) -> float:
+    return float(re.search(pattern, out, re.MULTILINE).group(1))
+
+
+def column_mean(out: str, column: int) -> float:
+    """Mean of a column of the rows of a table starting with a number."""
+    values = [float(line.split()[column]) for line in out.splitlines()
+              if re.match(r"\s*\d+(\s+[\d.]+%?)+\s*$", line)]
+    return sum(values) / len(values)
+
+
+def parse_percentiles(out: str) -> Dict[str, float]:
+    """Latency percentiles of outputs that have them, as in bench/latency."""
+    percentiles = {}
+    for p in ["p50", "p99", "p99.9"]:
+        match = re.search(r"^" + re.escape(p) + r"\s+(\d+) ns", out, re.MULTILINE)
+        if match:
+            percentiles[p] = float(match.group(1))
+    return percentiles
+
+
+# Name, command (a binary of bench/ and its arguments), whether it runs
+# threads, the unit of its headline throughput and how to get it from its
+# output
+WORKLOADS: List[Tuple[str, List[str], bool, str, Callable[[str], float]]] = [
+    ("benchmark", ["benchmark"], False, "replays/s",
+     lambda out: 1 / float(out.strip())),
+    ("latency", ["latency"], False, "Mops",
+     lambda out: 1e3 / first_float(r"mean (\d+)ns", out)),
+    ("startup", ["startup", "-n", "50"], False, "processes/s",
+     lambda out: 1e6 / first_float(r"([\d.]+)us per process", out)),
+    ("arena", ["arena"], False, "Mobjects/s",
+     lambda out: 1e3 / first_float(r"^malloc/free:\s+([\d.]+) ns", out)),
+    ("overhead", ["overhead", "200000"], False, "Mops churn",
+     lambda out: 1e3 / column_mean(out, 5)),
+    ("inline", ["inline", "20000"], False, "Mops",
+     lambda out: 1e3 / first_float(r"^my_malloc/my_free\s+\S+\s+([\d.]+)", out)),
+    # 2 + 4 + ... + 32 MB grown in total
+    ("realloc", ["realloc", "32"], False, "GB/s",
+     lambda out: 62 / first_float(r"^\s+total\s+([\d.]+)", out)),
+    ("profile", ["profile", "-n", "100000"], False, "Mops",
+     lambda out: 1e3 / first_float(r"^\s+off\s+([\d.]+)", out)),
+    ("containers", ["containers", "20", "10000"], False, "Melements/s map",
+     lambda out: 1e3 / first_float(r"^Allocator\s+([\d.]+)", out)),
+    ("scratch", ["scratch", "2", "200"], True, "ms packed",
+     lambda out: first_float(r"^packed\s+([\d.]+)", out)),
+    ("numa", ["numa", "2", "32"], True, "GB/s read",
+     lambda out: first_float(r"^fresh memory\s+\S+\s+([\d.]+)", out)),
+    ("central", ["central", "2", "200000"], True, "Mops",
+     lambda out: float(out.strip().splitlines()[-1].split()[1])),
+] + [
+    # bench/workloads, one row each, through my_malloc only
+    (name, ["workloads", "1", name, "my_malloc"], False, f"M{unit}/s",
+     lambda out, name=name: first_float(r"^" + name + r"\s+my_malloc\s+([\d.]+)", out))
+    for name, unit in [("json", "nodes"), ("tokens", "tokens"), ("hash", "ops"),
+                       ("rbtree", "ops"), ("lru", "reads")]
+]
+
+
+def high_water_mb(pid: int) -> float:
+    """Largest VmHWM of a running process and its descendants, as workloads
+    that fork do their work in children; 0 once it has exited."""
+    peak = 0
+    try:
+        with open(f"/proc/{pid}/status") as f:
+            for line in f:
+                if line.startswith("VmHWM:"):
+                    peak = int(line.split()[1]) / 1024
+        with open(f"/proc/{pid}/task/{pid}/children") as f:
+            children = [int(child) for child in f.read().split()]
+    except OSError:
+        return peak
+    for child in children:
+        peak = max(peak, high_water_mb(child))
+    return peak
+
+
+# ru_maxrss of a child starts at the resident size of this script, which it
+# keeps across exec, so it only tells peaks well above that apart
+SPAWN_FLOOR_MB = None
+SPAWN_MARGIN_MB = 1
+
+
+def run_measured(cmd: List[str], cwd: Path) -> Tuple[str, Optional[int], float, float]:
+    """Runs a command with stdout in a temporary file, and returns its output,
+    exit status (-signal if killed, None on timeout), wall time and peak RSS:
+    ru_maxrss when above the spawn floor, else the largest VmHWM sampled."""
+    with tempfile.TemporaryFile() as out:
+        start = time.monotonic()
+        # In a process group of its own, so a timeout kills its children too
+        p = subprocess.Popen(cmd, stdout=out, stderr=subprocess.STDOUT, cwd=cwd,
+                             start_new_session=True)
+        sampled_mb = 0
+        while True:
+            pid, status, usage = os.wait4(p.pid, os.WNOHANG)
+            if pid != 0:
+                break
+            if time.monotonic() - start > MATRIX_TIMEOUT:
+                os.killpg(p.pid, signal.SIGKILL)
+                pid, status, usage = os.wait4(p.pid, 0)
+                status = None
+                break
+            sampled_mb = max(sampled_mb, high_water_mb(p.pid))
+            time.sleep(0.005)
+        wall = time.monotonic() - start
+        # Popen must not wait for it again
+        p.returncode = 0
+        out.seek(0)
+        output = out.read().decode("UTF-8", errors="replace")
+    if status is not None:
+        status = os.waitstatus_to_exitcode(status)
+    # ru_maxrss is in KB on Linux
+    rss_mb = usage.ru_maxrss / 1024
+    if SPAWN_FLOOR_MB is not None and rss_mb <= SPAWN_FLOOR_MB + SPAWN_MARGIN_MB:
+        rss_mb = sampled_mb
+    return output, status, wall, rss_mb
+
+
+def run_workload(variant: str, name: str, command: List[str], threaded: bool,
+                 unit: str, parser: Callable[[str], float], cwd: Path) -> Result:
+    if threaded and variant not in THREAD_SAFE:
+        return Result("not thread safe")
+    print(f"{bcolors.OKCYAN}Running {bcolors.BOLD}{' '.join(command)}{bcolors.ENDC} ",
+          end='', flush=True)
+    output, status, wall, rss_mb = run_measured(
+        [f"{cwd}/bench/{command[0]}"] + command[1:], cwd)
+    if status is None:
+        print(f"{bcolors.WARNING}TIMEOUT{bcolors.ENDC}", flush=True)
+        return Result("timeout", wall, rss_mb)
+    if status != 0:
+        reason = signal.strsignal(-status) if status < 0 else f"exit {status}"
+        print(f"{bcolors.FAIL}FAIL ({reason}){bcolors.ENDC}", flush=True)
+        return Result(f"failed: {reason}", wall, rss_mb)
+    try:
+        throughput = f"{parser(output):.2f} {unit}"
+    except (AttributeError, ValueError, IndexError, ZeroDivisionError):
+        print(f"{bcolors.FAIL}NO RESULT{bcolors.ENDC}", flush=True)
+        return Result("no result in output", wall, rss_mb)
+    print(f"{bcolors.OKGREEN}OK ({wall:.2f}s){bcolors.ENDC}", flush=True)
+    return Result("ok", wall, rss_mb, throughput, parse_percentiles(output))
+
+
+def matrix_table(variants: List[str], results: Dict[Tuple[str, str], Result]) -> str:
+    header = ["workload", "variant", "wall s", "throughput",
+              "p50 ns", "p99 ns", "p99.9 ns", "peak RSS MB"]
+    rows = []
+    for name, *_ in WORKLOADS:
+        for variant in variants:
+            r = results[(name, variant)]
+            if r.status != "ok":
+                rows.append([name, variant, f"{r.wall:.2f}" if r.wall else "-", r.status,
+                             "-", "-", "-", f"{r.rss_mb:.1f}" if r.rss_mb else "-"])
+                continue
+            percentiles = [f"{r.percentiles[p]:.0f}" if p in r.percentiles else "-"
+                           for p in ["p50", "p99", "p99.9"]]
+            rows.append([name, variant, f"{r.wall:.2f}", r.throughput] +
+                        percentiles + [f"{r.rss_mb:.1f}"])
+    widths = [max(len(row[i]) for row in [header] + rows) for i in range(len(header))]
+    lines = ["| " + " | ".join(c.ljust(w) for c, w in zip(header, widths)) + " |",
+             "|" + "|".join("-" * (w + 2) for w in widths) + "|"]
+    lines += ["| " + " | ".join(c.ljust(w) for c, w in zip(row, widths)) + " |" for row in rows]
+    return "\n".join(lines) + "\n"
+
+
+def run_matrix(variants: List[str], script_path: Path, output_path: Optional[str]):
+    global SPAWN_FLOOR_MB
+    _, _, _, SPAWN_FLOOR_MB = run_measured(["true"], script_path)
+    results = {}
+    for variant in variants:
+        output, exit_code = make("clean", script_path)
+        check_make("clean", output, exit_code)
+        build_cmd = f"MALLOC={variant} RELEASE=1 bench"
+        output, exit_code = make(build_cmd, script_path)
+        if exit_code != SubprocessExit.Normal:
+            print(f"{bcolors.FAIL}FAIL{bcolors.ENDC}", flush=True)
+            for name, *_ in WORKLOADS:
+                results[(name, variant)] = Result("build failed")
+            continue
+        print(f"{bcolors.OKGREEN}OK{bcolors.ENDC}", flush=True)
+        for name, command, threaded, unit, parser in WORKLOADS:
+            results[(name, variant)] = run_workload(
+                variant, name, command, threaded, unit, parser, script_path)
+    table = matrix_table(variants, results)
+    print(table, end='')
+    if output_path is not None:
+        with open(output_path, "w") as f:
+            f.write(table)
 
 
 def main():
@@ -204,6 +472,9 @@ def main():
 
     script_path = os.path.realpath(__file__)
     script_path = Path(script_path).parent.absolute()
+    if args.matrix:
+        run_matrix(args.variants.split(","), script_path, args.output)
+        return
     # Clean
     output, exit_code = make("clean", script_path)
     check_make("clean", output, exit_code)
@@ -0,0 +1,65 @@
+#include "../tests/testing.h"
+#include "../src/myarena.h"
+#include <stdint.h>
+#include <time.h>
+
+/* Arena benchmark: simulates requests that each allocate many small objects
+   and drop them all at the end, once with my_malloc/my_free per object and
+   once with an arena that is reset after every request.
+
+   Usage: arena [requests] [objects_per_request] */
+
+#define MAX_SIZE 256
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static unsigned long long rng_state = 88172645463325252ull;
+
+static size_t next_size(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return 16 + rng_state % (MAX_SIZE - 15);
+}
+
+int main(int argc, char **argv) {
+  size_t requests = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000;
+  size_t objects = argc > 2 ? strtoul(argv[2], NULL, 0) : 1000;
+  void **ptrs = mallocing(objects * sizeof(void *));
+
+  uint64_t start = now_ns();
+  for (size_t r = 0; r < requests; r++) {
+    for (size_t i = 0; i < objects; i++) {
+      ptrs[i] = mallocing(next_size());
+      *(char *) ptrs[i] = 1;
+    }
+    for (size_t i = 0; i < objects; i++) {
+      freeing(ptrs[i]);
+    }
+  }
+  double malloc_ns = (double) (now_ns() - start) / (requests * objects);
+
+  Arena *arena = my_arena_create(0);
+  CHECK_NULL(arena);
+  start = now_ns();
+  for (size_t r = 0; r < requests; r++) {
+    for (size_t i = 0; i < objects; i++) {
+      char *p = my_arena_alloc(arena, next_size());
+      CHECK_NULL(p);
+      *p = 1;
+    }
+    my_arena_reset(arena);
+  }
+  double arena_ns = (double) (now_ns() - start) / (requests * objects);
+  my_arena_destroy(arena);
+  freeing(ptrs);
+
+  printf("%zu requests of %zu objects (16-%d bytes)\n", requests, objects, MAX_SIZE);
+  printf("malloc/free: %8.1f ns per object\n", malloc_ns);
+  printf("arena:       %8.1f ns per object (%.1fx)\n", arena_ns, malloc_ns / arena_ns);
+  return 0;
+}
@@ -14,13 +14,15 @@
    <https://www.gnu.org/licenses/>.  */
 
 #include "../tests/testing.h"
+#include "counters.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/resource.h>
 #include <time.h>
 
 /* Benchmark the malloc/free performance of a varying number of blocks of a
-   given size. */
+   given size. Prints the CPU time taken, then the event counts of each
+   size (see counters.h) where the machine has event counters. */
 
 #define NUM_ITERS 300
 #define NUM_ALLOCS 4
@@ -32,7 +34,8 @@ typedef struct {
   int n;
 } malloc_args;
 
-static void do_benchmark(malloc_args *args, char **arr) {
+/* Returns the number of mallocs and frees. */
+static size_t do_benchmark(malloc_args *args, char **arr) {
   size_t iters = args->iters;
   size_t size = args->size;
   int n = args->n;
@@ -55,14 +58,16 @@ static void do_benchmark(malloc_args *args, char **arr) {
       freeing(arr[i]);
     }
   }
-
+  return 2 * iters * n;
 }
 
 static malloc_args tests[3][NUM_ALLOCS];
 static int allocs[NUM_ALLOCS] = {25, 100, 400, MAX_ALLOCS};
 
-void bench(unsigned long size) {
+/* Returns the number of mallocs and frees. */
+size_t bench(unsigned long size) {
   size_t iters = NUM_ITERS;
+  size_t ops = 0;
   char **arr = (char **)mallocing(MAX_ALLOCS * sizeof(void *));
   for (int t = 0; t < 3; t++)
     for (int i = 0; i < NUM_ALLOCS; i++) {
@@ -72,12 +77,13 @@ void bench(unsigned long size) {
 
       /* Do a quick warmup run.  */
       if (t == 0)
-        do_benchmark(&tests[0][i], arr);
+        ops += do_benchmark(&tests[0][i], arr);
     }
   /* Run benchmark single threaded in main_arena.  */
   for (int i = 0; i < NUM_ALLOCS; i++)
-    do_benchmark(&tests[0][i], arr);
+    ops += do_benchmark(&tests[0][i], arr);
   freeing(arr);
+  return ops;
 }
 
 static void usage(const char *name) {
@@ -94,19 +100,40 @@ int main(int argc, char **argv) {
   if (argc > 2 || size <= 0)
     usage(argv[0]);
 
+  const int multiples[] = {1, 2, 4, 6, 8, 10, 12, 14, 16};
+  const int sizes = sizeof(multiples) / sizeof(multiples[0]);
+  Counters total;
+  counters_open(&total);
+  // Share the counters, each with counts of its own
+  Counters per_size[sizes];
+  size_t ops[sizes];
+  for (int s = 0; s < sizes; s++) {
+    per_size[s] = total;
+    ops[s] = 0;
+  }
+
   for (int i = 0; i < 100; i++) {
-    bench(size);
-    bench(2 * size);
-    bench(4 * size);
-    bench(6 * size);
-    bench(8 * size);
-    bench(10 * size);
-    bench(12 * size);
-    bench(14 * size);
-    bench(16 * size);
+    for (int s = 0; s < sizes; s++) {
+      counters_start(&per_size[s]);
+      ops[s] += bench(multiples[s] * size);
+      counters_stop(&per_size[s]);
+    }
   }
   clock_t end_t = clock();
   double time_taken = (double)(end_t - start_t) / CLOCKS_PER_SEC;
   printf("%f\n", time_taken);
+
+  size_t total_ops = 0;
+  for (int s = 0; s < sizes; s++) {
+    char label[32];
+    snprintf(label, sizeof(label), "size-%ld", multiples[s] * size);
+    counters_print(stdout, &per_size[s], label, ops[s]);
+    for (int c = 0; c < COUNTERS; c++) {
+      total.values[c] += per_size[s].values[c];
+    }
+    total_ops += ops[s];
+  }
+  counters_print(stdout, &total, "total", total_ops);
+  counters_close(&total);
   return 0;
 }
@@ -0,0 +1,128 @@
+#include "../tests/testing.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Central free list scalability benchmark: each thread allocates objects of
+   48 bytes through the thread cache and hands them to the next thread in a
+   ring, which frees them, so every thread's cache overflows on one end and
+   runs dry on the other and all refills and flushes go through the central
+   lists (or, with MYMALLOC_CENTRAL=0, through the locked heap). It reports
+   millions of objects per second for 1 to max_threads threads, with the
+   central lists on and off, each run in a child process.
+
+   Usage: central [max_threads] [objects_per_thread] */
+
+#define BATCH 256
+#define SIZE 48
+
+typedef struct {
+  void ***slot;
+  void ***next_slot;
+  size_t objects;
+} Worker;
+
+typedef struct {
+  // Array of BATCH objects handed over, or NULL
+  void **objects;
+  char pad[56];
+} Slot;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void *worker_main(void *arg) {
+  Worker *w = arg;
+  void **batch = mallocing(BATCH * sizeof(void *));
+  for (size_t done = 0; done < w->objects; done += BATCH) {
+    for (int i = 0; i < BATCH; i++) {
+      batch[i] = my_malloc_inline(SIZE);
+    }
+    // Hand them to the next thread, and free what the previous one left
+    void **theirs = __atomic_exchange_n(w->next_slot, batch, __ATOMIC_ACQ_REL);
+    if (theirs == NULL) {
+      theirs = mallocing(BATCH * sizeof(void *));
+    } else {
+      for (int i = 0; i < BATCH; i++) {
+        my_free_inline(theirs[i], SIZE);
+      }
+    }
+    batch = theirs;
+    theirs = __atomic_exchange_n(w->slot, NULL, __ATOMIC_ACQ_REL);
+    if (theirs != NULL) {
+      for (int i = 0; i < BATCH; i++) {
+        my_free_inline(theirs[i], SIZE);
+      }
+      freeing(theirs);
+    }
+  }
+  freeing(batch);
+  return NULL;
+}
+
+/* Returns millions of objects per second with n_threads threads. */
+static double run(int n_threads, size_t objects) {
+  Slot *slots = mallocing(n_threads * sizeof(Slot));
+  Worker *workers = mallocing(n_threads * sizeof(Worker));
+  pthread_t *threads = mallocing(n_threads * sizeof(pthread_t));
+  for (int i = 0; i < n_threads; i++) {
+    slots[i].objects = NULL;
+    workers[i] = (Worker) {&slots[i].objects, &slots[(i + 1) % n_threads].objects, objects};
+  }
+  uint64_t start = now_ns();
+  for (int i = 0; i < n_threads; i++) {
+    pthread_create(&threads[i], NULL, worker_main, &workers[i]);
+  }
+  for (int i = 0; i < n_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  double mops = (double) n_threads * objects / ((now_ns() - start) / 1e3);
+  freeing(threads);
+  freeing(workers);
+  freeing(slots);
+  return mops;
+}
+
+int main(int argc, char **argv) {
+  int max_threads = argc > 1 ? atoi(argv[1]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+  size_t objects = argc > 2 ? strtoul(argv[2], NULL, 0) : 2000000;
+
+  printf("%zu objects of %d bytes per thread\n", objects, SIZE);
+  printf("%8s %14s %14s\n", "threads", "central Mops", "heap Mops");
+  for (int n = 1; n <= max_threads; n *= 2) {
+    double mops[2];
+    for (int central = 1; central >= 0; central--) {
+      int fds[2];
+      if (pipe(fds) != 0) {
+        return 1;
+      }
+      fflush(stdout);
+      pid_t pid = fork();
+      if (pid == 0) {
+        setenv("MYMALLOC_CENTRAL", central ? "1" : "0", 1);
+        double result = run(n, objects);
+        if (write(fds[1], &result, sizeof(result)) != sizeof(result)) {
+          _exit(1);
+        }
+        _exit(0);
+      }
+      mops[central] = 0;
+      if (read(fds[0], &mops[central], sizeof(double)) != sizeof(double)) {
+        mops[central] = 0;
+      }
+      waitpid(pid, NULL, 0);
+      close(fds[0]);
+      close(fds[1]);
+    }
+    printf("%8d %14.2f %14.2f\n", n, mops[1], mops[0]);
+    if (n < max_threads && n * 2 > max_threads) {
+      n = max_threads / 2;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,138 @@
+#include "../src/mymalloc.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+/* Container churn benchmark: fills and empties a std::map, a
+   std::unordered_map and a std::vector<std::string> over and over, once with
+   the default allocator (glibc malloc through operator new), once with
+   mymalloc::Allocator and once with std::pmr containers on
+   mymalloc::memory_resource(), and reports ns per element. Each allocator
+   runs in a child process of its own, so it starts from a fresh heap.
+
+   Usage: containers [rounds] [elements] */
+
+struct DefaultAllocator {
+  template <typename T>
+  using type = std::allocator<T>;
+};
+
+struct MyAllocator {
+  template <typename T>
+  using type = mymalloc::Allocator<T>;
+};
+
+// Default constructed, so it uses the default resource set in main
+struct PmrAllocator {
+  template <typename T>
+  using type = std::pmr::polymorphic_allocator<T>;
+};
+
+static unsigned long long rng_state = 88172645463325252ull;
+
+static unsigned long long next_random() {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+static double now_ns() {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Keeps the work from being optimised away
+static size_t checksum = 0;
+
+template <typename Policy>
+static double map_churn(size_t rounds, size_t n) {
+  using Map = std::map<size_t, size_t, std::less<size_t>, typename Policy::template type<std::pair<const size_t, size_t>>>;
+  double start = now_ns();
+  for (size_t r = 0; r < rounds; r++) {
+    Map map;
+    for (size_t i = 0; i < n; i++) {
+      map[next_random() % (4 * n)] = i;
+    }
+    // Erase half one by one, drop the rest with the map
+    for (size_t i = 0; i < n / 2; i++) {
+      map.erase(next_random() % (4 * n));
+    }
+    checksum += map.size();
+  }
+  return (now_ns() - start) / (rounds * n);
+}
+
+template <typename Policy>
+static double unordered_map_churn(size_t rounds, size_t n) {
+  using Map = std::unordered_map<size_t, size_t, std::hash<size_t>, std::equal_to<size_t>, typename Policy::template type<std::pair<const size_t, size_t>>>;
+  double start = now_ns();
+  for (size_t r = 0; r < rounds; r++) {
+    Map map;
+    for (size_t i = 0; i < n; i++) {
+      map[next_random() % (4 * n)] = i;
+    }
+    for (size_t i = 0; i < n / 2; i++) {
+      map.erase(next_random() % (4 * n));
+    }
+    checksum += map.size();
+  }
+  return (now_ns() - start) / (rounds * n);
+}
+
+template <typename Policy>
+static double string_vector_churn(size_t rounds, size_t n) {
+  using String = std::basic_string<char, std::char_traits<char>, typename Policy::template type<char>>;
+  using Vector = std::vector<String, typename Policy::template type<String>>;
+  double start = now_ns();
+  for (size_t r = 0; r < rounds; r++) {
+    Vector strings;
+    for (size_t i = 0; i < n; i++) {
+      // Longer than the small string buffer, so every string allocates
+      strings.emplace_back(16 + next_random() % 112, 'a' + i % 26);
+    }
+    for (size_t i = 0; i < n; i += 4) {
+      strings[i].append(64, 'z');
+    }
+    checksum += strings[n / 2].size();
+  }
+  return (now_ns() - start) / (rounds * n);
+}
+
+template <typename Policy>
+static void run(const char *name, size_t rounds, size_t n) {
+  std::fflush(stdout);
+  pid_t pid = fork();
+  if (pid != 0) {
+    waitpid(pid, nullptr, 0);
+    return;
+  }
+  if (std::is_same<Policy, PmrAllocator>::value) {
+    std::pmr::set_default_resource(mymalloc::memory_resource());
+  }
+  double map_ns = map_churn<Policy>(rounds, n);
+  double unordered_ns = unordered_map_churn<Policy>(rounds, n);
+  double strings_ns = string_vector_churn<Policy>(rounds, n);
+  std::printf("%-10s %14.1f %14.1f %14.1f\n", name, map_ns, unordered_ns, strings_ns);
+  std::exit(checksum == 0);
+}
+
+int main(int argc, char **argv) {
+  size_t rounds = argc > 1 ? std::strtoul(argv[1], nullptr, 0) : 100;
+  size_t n = argc > 2 ? std::strtoul(argv[2], nullptr, 0) : 10000;
+
+  std::printf("%zu rounds of %zu elements, ns per element\n", rounds, n);
+  std::printf("%-10s %14s %14s %14s\n", "allocator", "map", "unordered_map", "vector<string>");
+  run<DefaultAllocator>("default", rounds, n);
+  run<MyAllocator>("Allocator", rounds, n);
+  run<PmrAllocator>("pmr", rounds, n);
+  return 0;
+}
@@ -0,0 +1,132 @@
+#ifndef BENCH_COUNTERS_HEADER
+#define BENCH_COUNTERS_HEADER
+
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* Event counters for the benchmarks, through perf_event_open: what a
+   variant spends its time on, in cache and TLB misses, branch mispredicts
+   and page faults. Each counter is opened on its own, so those the machine
+   or the kernel doesn't offer (virtual machines often have no hardware
+   counters, and perf_event_paranoid may forbid them) read as n/a, and with
+   none at all nothing is printed. They count user space only, of the
+   calling thread and the threads it creates after, and are scaled up when
+   the kernel multiplexed them.
+
+   counters_print writes a line per workload, which bench.py reads:
+     counters <label> <ops> ops  <name> <count> (<per op>/op) ... */
+
+enum {
+  COUNTER_CYCLES,
+  COUNTER_INSTRUCTIONS,
+  COUNTER_CACHE_MISSES,
+  COUNTER_DTLB_MISSES,
+  COUNTER_BRANCH_MISSES,
+  COUNTER_PAGE_FAULTS,
+  COUNTERS
+};
+
+static const char *const counter_names[COUNTERS] = {
+    "cycles", "instructions", "cache-misses", "dtlb-misses", "branch-misses", "page-faults",
+};
+
+typedef struct {
+  // -1 where the counter is not available
+  int fds[COUNTERS];
+  // Counts since counters_open, of the intervals between start and stop
+  uint64_t values[COUNTERS];
+} Counters;
+
+static inline int counter_open(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = type;
+  attr.size = sizeof(attr);
+  attr.config = config;
+  attr.disabled = 1;
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static inline void counters_open(Counters *c) {
+  c->fds[COUNTER_CYCLES] = counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  c->fds[COUNTER_INSTRUCTIONS] = counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  c->fds[COUNTER_CACHE_MISSES] = counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+  c->fds[COUNTER_DTLB_MISSES] = counter_open(
+      PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+  c->fds[COUNTER_BRANCH_MISSES] = counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+  c->fds[COUNTER_PAGE_FAULTS] = counter_open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+  memset(c->values, 0, sizeof(c->values));
+}
+
+/* Returns 1 if any counter is available. */
+static inline int counters_any(const Counters *c) {
+  for (int i = 0; i < COUNTERS; i++) {
+    if (c->fds[i] >= 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static inline void counters_start(Counters *c) {
+  for (int i = 0; i < COUNTERS; i++) {
+    if (c->fds[i] >= 0) {
+      ioctl(c->fds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(c->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+}
+
+/* Stops the counters and adds what they counted since counters_start. */
+static inline void counters_stop(Counters *c) {
+  for (int i = 0; i < COUNTERS; i++) {
+    if (c->fds[i] < 0) {
+      continue;
+    }
+    ioctl(c->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    // Value, time enabled and time running
+    uint64_t data[3];
+    if (read(c->fds[i], data, sizeof(data)) == sizeof(data) && data[2] > 0) {
+      c->values[i] += data[2] < data[1] ? (uint64_t) ((double) data[0] * data[1] / data[2]) : data[0];
+    }
+  }
+}
+
+static inline void counters_close(Counters *c) {
+  for (int i = 0; i < COUNTERS; i++) {
+    if (c->fds[i] >= 0) {
+      close(c->fds[i]);
+      c->fds[i] = -1;
+    }
+  }
+}
+
+/* Prints the counts of a workload of `ops` operations, if any counter is
+   available. `label` has no spaces. */
+static inline void counters_print(FILE *out, const Counters *c, const char *label, uint64_t ops) {
+  if (!counters_any(c)) {
+    return;
+  }
+  fprintf(out, "counters %s %llu ops", label, (unsigned long long) ops);
+  for (int i = 0; i < COUNTERS; i++) {
+    if (c->fds[i] < 0) {
+      fprintf(out, "  %s n/a", counter_names[i]);
+    } else {
+      fprintf(out, "  %s %llu (%.4g/op)", counter_names[i], (unsigned long long) c->values[i],
+              ops > 0 ? (double) c->values[i] / ops : 0.0);
+    }
+  }
+  fprintf(out, "\n");
+}
+
+#endif
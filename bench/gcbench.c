@@ -0,0 +1,139 @@
+#include "../src/mygc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/* GC throughput and pause benchmark, built like mygctest.c: it registers the
+   stack, keeps a long-lived binary tree alive and churns short-lived trees
+   through my_malloc, collecting explicitly every `gc_every` allocations.
+   With -i the collector runs incrementally instead, in slices of `work`
+   bytes (and at most `time` microseconds if given) driven by my_malloc, and
+   the pause figures are per slice. With -G the collector is generational
+   with a nursery of `nursery_kb` KB, collected whenever it fills up, and
+   the minor and full collections are reported separately. Child pointers
+   go through the write barrier, as a parent may be promoted while its
+   subtrees are built.
+
+   Usage: gcbench [-d live_depth] [-n iterations] [-g gc_every] [-i work] [-t time_us]
+                  [-G nursery_kb] [-p promote_after] */
+
+typedef struct Tree Tree;
+struct Tree {
+  Tree *left;
+  Tree *right;
+  size_t payload[2];
+};
+
+static size_t allocations = 0;
+
+static Tree *make_tree(int depth) {
+  Tree *t = my_malloc(sizeof(Tree));
+  allocations++;
+  t->payload[0] = depth;
+  t->payload[1] = 0;
+  if (depth > 0) {
+    t->left = NULL;
+    t->right = NULL;
+    my_gc_write_barrier((void **) &t->left, make_tree(depth - 1));
+    my_gc_write_barrier((void **) &t->right, make_tree(depth - 1));
+  } else {
+    t->left = NULL;
+    t->right = NULL;
+  }
+  return t;
+}
+
+static double seconds(struct timespec a, struct timespec b) {
+  return (double) (b.tv_sec - a.tv_sec) + (double) (b.tv_nsec - a.tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv) {
+  set_start_of_stack(__builtin_frame_address(0));
+  int live_depth = 18;
+  int iterations = 200;
+  size_t gc_every = 1 << 18;
+  size_t slice_work = 0;
+  uint64_t slice_us = 0;
+  size_t nursery_kb = 0;
+  int promote_after = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "d:n:g:i:t:G:p:")) != -1) {
+    switch (opt) {
+      case 'd':
+        live_depth = atoi(optarg);
+        break;
+      case 'n':
+        iterations = atoi(optarg);
+        break;
+      case 'g':
+        gc_every = strtoul(optarg, NULL, 0);
+        break;
+      case 'i':
+        slice_work = strtoul(optarg, NULL, 0);
+        break;
+      case 't':
+        slice_us = strtoull(optarg, NULL, 0);
+        break;
+      case 'G':
+        nursery_kb = strtoul(optarg, NULL, 0);
+        break;
+      case 'p':
+        promote_after = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-d live_depth] [-n iterations] [-g gc_every] [-i work] [-t time_us] [-G nursery_kb] [-p promote_after]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (slice_work > 0) {
+    my_gc_set_incremental(1, slice_work, slice_us * 1000);
+  }
+  if (nursery_kb > 0) {
+    my_gc_set_generational(1, nursery_kb << 10, promote_after);
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  Tree *live = make_tree(live_depth);
+  size_t next_gc = allocations + gc_every;
+  for (int i = 0; i < iterations; i++) {
+    Tree *garbage = make_tree(10);
+    garbage->payload[1] = i;
+    if (slice_work == 0 && nursery_kb == 0 && allocations >= next_gc) {
+      my_gc();
+      next_gc = allocations + gc_every;
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  struct GCStats stats;
+  my_gc_get_stats(&stats);
+  double elapsed = seconds(start, end);
+
+  printf("live tree depth:   %d (%zu bytes live)\n", live_depth, stats.live_bytes);
+  printf("allocations:       %zu in %.3fs (%.0f allocs/s)\n", allocations, elapsed, allocations / elapsed);
+  printf("heap size:         %zu bytes\n", stats.heap_size);
+  printf("collections:       %zu\n", stats.collections);
+  if (nursery_kb > 0) {
+    size_t full = stats.collections;
+    printf("minor collections: %zu, %zu bytes promoted\n", stats.minor_collections, stats.promoted_bytes);
+    if (stats.minor_collections > 0) {
+      printf("minor pause avg:   %.3fms\n", stats.minor_pause_ns / 1e6 / stats.minor_collections);
+    }
+    if (full > 0) {
+      printf("full pause avg:    %.3fms\n", (stats.total_pause_ns - stats.minor_pause_ns) / 1e6 / full);
+    }
+    printf("max pause:         %.3fms\n", stats.max_pause_ns / 1e6);
+    printf("time in gc:        %.1f%%\n", 100.0 * stats.total_pause_ns / 1e9 / elapsed);
+  } else if (slice_work > 0 && stats.slices > 0) {
+    printf("slices:            %zu\n", stats.slices);
+    printf("slice pause avg/max: %.3fms / %.3fms\n", stats.total_pause_ns / 1e6 / stats.slices, stats.max_pause_ns / 1e6);
+    printf("time in gc:        %.1f%%\n", 100.0 * stats.total_pause_ns / 1e9 / elapsed);
+  } else if (stats.collections > 0) {
+    printf("pause avg/max:     %.3fms / %.3fms\n", stats.total_pause_ns / 1e6 / stats.collections, stats.max_pause_ns / 1e6);
+    printf("time in gc:        %.1f%%\n", 100.0 * stats.total_pause_ns / 1e9 / elapsed);
+  }
+  return live->payload[0] != (size_t) live_depth;
+}
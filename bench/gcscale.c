@@ -0,0 +1,94 @@
+#include "../src/mygc.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* GC pause scaling benchmark: builds a synthetic object graph of growing size
+   with my_malloc and reports the pause and mark time of a full collection for
+   every mark thread count from 1 up to max_threads (doubling).
+
+   The graph is a 4-ary tree of nodes of 32-256 bytes with a random cross edge
+   per node, plus one 1 MB pointer array per 64 MB of heap to exercise the
+   splitting of large objects between mark threads.
+
+   Usage: gcscale [max_heap_mb] [max_threads] */
+
+#define FANOUT 4
+#define RUNS 3
+
+typedef struct Node Node;
+struct Node {
+  Node *children[FANOUT];
+  Node *cross;
+  size_t words[];
+};
+
+// Volatile so the stores that keep the graph reachable aren't optimised away
+static Node *volatile root = NULL;
+static void **volatile arrays = NULL;
+
+static unsigned long long rng_state = 88172645463325252ull;
+
+static unsigned long long next_random(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+/* Builds the graph until it holds about `bytes` bytes. */
+static void build_graph(size_t bytes) {
+  size_t n = bytes / 160;
+  Node **index = my_malloc(n * sizeof(Node *));
+  for (size_t i = 0; i < n; i++) {
+    size_t extra = (next_random() % 28) * sizeof(size_t);
+    index[i] = my_malloc(sizeof(Node) + extra);
+    memset(index[i], 0, sizeof(Node) + extra);
+  }
+  for (size_t i = 0; i < n; i++) {
+    for (int c = 0; c < FANOUT; c++) {
+      size_t child = FANOUT * i + c + 1;
+      index[i]->children[c] = child < n ? index[child] : NULL;
+    }
+    index[i]->cross = index[next_random() % n];
+  }
+  size_t n_arrays = bytes / (64 << 20) + 1;
+  size_t array_len = (1 << 20) / sizeof(void *);
+  arrays = my_malloc(n_arrays * sizeof(void *));
+  for (size_t a = 0; a < n_arrays; a++) {
+    void **array = my_malloc(array_len * sizeof(void *));
+    for (size_t i = 0; i < array_len; i++) {
+      array[i] = index[next_random() % n];
+    }
+    arrays[a] = array;
+  }
+  root = index[0];
+  my_free(index);
+}
+
+int main(int argc, char **argv) {
+  set_start_of_stack(__builtin_frame_address(0));
+  size_t max_heap_mb = argc > 1 ? strtoul(argv[1], NULL, 0) : 256;
+  int max_threads = argc > 2 ? atoi(argv[2]) : 8;
+
+  printf("%10s %8s %12s %12s\n", "heap(MB)", "threads", "pause(ms)", "mark(ms)");
+  for (size_t heap_mb = 16; heap_mb <= max_heap_mb; heap_mb *= 4) {
+    build_graph(heap_mb << 20);
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+      my_gc_set_threads(threads);
+      double best_pause = 0, best_mark = 0;
+      for (int run = 0; run < RUNS; run++) {
+        struct GCStats stats;
+        my_gc();
+        my_gc_get_stats(&stats);
+        if (run == 0 || stats.last_pause_ns / 1e6 < best_pause) {
+          best_pause = stats.last_pause_ns / 1e6;
+          best_mark = stats.last_mark_ns / 1e6;
+        }
+      }
+      printf("%10zu %8d %12.3f %12.3f\n", heap_mb, threads, best_pause, best_mark);
+    }
+    root = NULL;
+    arrays = NULL;
+  }
+  return 0;
+}
@@ -0,0 +1,88 @@
+#include "../tests/testing.h"
+#include "counters.h"
+#include <stdint.h>
+#include <time.h>
+
+/* Constant-size fast path benchmark: allocates and frees batches of 48
+   byte objects with my_malloc/my_free, my_malloc/my_free_sized and the
+   inline my_malloc_inline/my_free_inline, and reports instructions (where
+   perf events are available) and ns per allocation and free, then the
+   event counts of each path (see counters.h).
+
+   Usage: inline [rounds] */
+
+#define BATCH 64
+#define SIZE 48
+
+static void *blocks[BATCH];
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void run_malloc(void) {
+  for (int i = 0; i < BATCH; i++) {
+    blocks[i] = my_malloc(SIZE);
+  }
+  for (int i = 0; i < BATCH; i++) {
+    my_free(blocks[i]);
+  }
+}
+
+static void run_sized(void) {
+  for (int i = 0; i < BATCH; i++) {
+    blocks[i] = my_malloc(SIZE);
+  }
+  for (int i = 0; i < BATCH; i++) {
+    my_free_sized(blocks[i], SIZE);
+  }
+}
+
+static void run_inline(void) {
+  for (int i = 0; i < BATCH; i++) {
+    blocks[i] = my_malloc_inline(SIZE);
+  }
+  for (int i = 0; i < BATCH; i++) {
+    my_free_inline(blocks[i], SIZE);
+  }
+}
+
+int main(int argc, char **argv) {
+  size_t rounds = argc > 1 ? strtoul(argv[1], NULL, 0) : 100000;
+  const char *names[] = {"my_malloc/my_free", "my_free_sized", "inline"};
+  void (*runs[])(void) = {run_malloc, run_sized, run_inline};
+  Counters counters[3];
+  counters_open(&counters[0]);
+  counters[1] = counters[2] = counters[0];
+
+  printf("%zu rounds of %d allocations of %d bytes\n", rounds, BATCH, SIZE);
+  printf("%-20s %14s %10s\n", "path", "instructions", "ns");
+  for (int r = 0; r < 3; r++) {
+    // Warm up, which also fills the thread cache
+    runs[r]();
+    counters_start(&counters[r]);
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < rounds; i++) {
+      runs[r]();
+    }
+    double ns = (double) (now_ns() - start) / (rounds * BATCH);
+    counters_stop(&counters[r]);
+    uint64_t instructions = counters[r].values[COUNTER_INSTRUCTIONS];
+    printf("%-20s", names[r]);
+    if (instructions > 0) {
+      printf(" %14.1f", (double) instructions / (rounds * BATCH));
+    } else {
+      printf(" %14s", "n/a");
+    }
+    printf(" %10.1f\n", ns);
+  }
+  // Per allocation and free, as above
+  const char *labels[] = {"malloc/free", "free_sized", "inline"};
+  for (int r = 0; r < 3; r++) {
+    counters_print(stdout, &counters[r], labels[r], rounds * BATCH);
+  }
+  counters_close(&counters[0]);
+  return 0;
+}
@@ -0,0 +1,69 @@
+#include "../tests/testing.h"
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/* Tail latency harness: times every my_malloc call of a workload that grows
+   the heap over several chunks, and prints latency percentiles. Each block is
+   written once, as a program would, so first-touch page faults in the
+   allocator's own header and footer writes count against it.
+
+   Sizes are uniform in [16, max_size]; one in `free_every` blocks is freed
+   again right away to keep some holes in the free list.
+
+   Usage: latency [allocations] [max_size] [free_every]
+   e.g.   MYMALLOC_SPARE_CHUNK=1 ./bench/latency */
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return (x > y) - (x < y);
+}
+
+static unsigned long long rng_state = 88172645463325252ull;
+
+static unsigned long long next_random(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+int main(int argc, char **argv) {
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 100000;
+  size_t max_size = argc > 2 ? strtoul(argv[2], NULL, 0) : 4096;
+  size_t free_every = argc > 3 ? strtoul(argv[3], NULL, 0) : 8;
+
+  uint64_t *samples = malloc(n * sizeof(uint64_t));
+  // Warm up the allocator so initialisation is not in the samples
+  my_free(mallocing(16));
+
+  uint64_t total = 0;
+  for (size_t i = 0; i < n; i++) {
+    size_t size = 16 + next_random() % (max_size - 15);
+    uint64_t start = now_ns();
+    char *p = mallocing(size);
+    samples[i] = now_ns() - start;
+    total += samples[i];
+    memset(p, 0, size);
+    if (free_every > 0 && i % free_every == 0) {
+      freeing(p);
+    }
+  }
+
+  qsort(samples, n, sizeof(uint64_t), compare_u64);
+  printf("allocations: %zu, mean %.0fns\n", n, (double) total / n);
+  const double percentiles[] = {50, 90, 99, 99.9, 99.99};
+  for (int i = 0; i < 5; i++) {
+    size_t rank = (size_t) (percentiles[i] / 100 * (n - 1));
+    printf("p%-6g %10llu ns\n", percentiles[i], (unsigned long long) samples[rank]);
+  }
+  printf("max     %10llu ns\n", (unsigned long long) samples[n - 1]);
+  free(samples);
+  return 0;
+}
@@ -0,0 +1,198 @@
+#define _GNU_SOURCE
+#include "../tests/testing.h"
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* NUMA locality benchmark: one thread per CPU (pinned) allocates and fills
+   blocks, then reads them back a few times. It reports the share of the
+   blocks' pages that sit on the thread's own node (from move_pages) and read
+   bandwidth, plus the share of loads served by a remote node where the CPU
+   exposes the node-loads/node-load-misses perf events. The second round runs
+   after every thread freed the blocks of the next one, so it shows whether
+   freed memory is reused on its own node.
+
+   Usage: numa [threads] [mb_per_thread] [block_size] */
+
+#define PASSES 5
+
+typedef struct {
+  int id;
+  int cpu;
+  size_t n_blocks;
+  size_t block_size;
+  char **blocks;
+  // Per round
+  size_t local_pages[2];
+  size_t pages[2];
+  uint64_t read_ns[2];
+  uint64_t node_loads[2];
+  uint64_t node_misses[2];
+} Worker;
+
+static Worker *workers;
+static int n_threads;
+static pthread_barrier_t barrier;
+static volatile size_t sink;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/* Opens a counter of node loads (or of those that missed the local node)
+   for the calling thread, or returns -1. */
+static int open_node_counter(int misses) {
+  struct perf_event_attr attr = {0};
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_CACHE_NODE | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                ((misses ? PERF_COUNT_HW_CACHE_RESULT_MISS : PERF_COUNT_HW_CACHE_RESULT_ACCESS) << 16);
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t read_counter(int fd) {
+  uint64_t value = 0;
+  if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value)) {
+    return 0;
+  }
+  return value;
+}
+
+/* Counts the pages of the worker's blocks that are on `node`. */
+static void count_local_pages(Worker *w, int round, int node) {
+  size_t per_block = (w->block_size + 4095) / 4096;
+  size_t n = w->n_blocks * per_block;
+  void **pages = mallocing(n * sizeof(void *));
+  int *status = mallocing(n * sizeof(int));
+  for (size_t b = 0; b < w->n_blocks; b++) {
+    for (size_t p = 0; p < per_block; p++) {
+      size_t offset = p * 4096 < w->block_size ? p * 4096 : w->block_size - 1;
+      pages[b * per_block + p] = w->blocks[b] + offset;
+    }
+  }
+  // Without target nodes, move_pages only reports where each page is
+  if (syscall(SYS_move_pages, 0, n, pages, NULL, status, 0) == 0) {
+    for (size_t i = 0; i < n; i++) {
+      w->local_pages[round] += status[i] == node;
+    }
+    w->pages[round] = n;
+  }
+  freeing(status);
+  freeing(pages);
+}
+
+static void run_round(Worker *w, int round) {
+  unsigned cpu, node;
+  w->blocks = mallocing(w->n_blocks * sizeof(char *));
+  for (size_t b = 0; b < w->n_blocks; b++) {
+    w->blocks[b] = mallocing(w->block_size);
+    memset(w->blocks[b], (int) b, w->block_size);
+  }
+  getcpu(&cpu, &node);
+  count_local_pages(w, round, (int) node);
+
+  int loads = open_node_counter(0), misses = open_node_counter(1);
+  ioctl(loads, PERF_EVENT_IOC_ENABLE, 0);
+  ioctl(misses, PERF_EVENT_IOC_ENABLE, 0);
+  uint64_t start = now_ns();
+  size_t sum = 0;
+  for (int pass = 0; pass < PASSES; pass++) {
+    for (size_t b = 0; b < w->n_blocks; b++) {
+      const size_t *words = (const size_t *) w->blocks[b];
+      for (size_t i = 0; i < w->block_size / sizeof(size_t); i++) {
+        sum += words[i];
+      }
+    }
+  }
+  w->read_ns[round] = now_ns() - start;
+  w->node_loads[round] = read_counter(loads);
+  w->node_misses[round] = read_counter(misses);
+  if (loads >= 0) close(loads);
+  if (misses >= 0) close(misses);
+  sink += sum;
+}
+
+static void free_blocks(Worker *w) {
+  for (size_t b = 0; b < w->n_blocks; b++) {
+    freeing(w->blocks[b]);
+  }
+  freeing(w->blocks);
+}
+
+static void *worker_main(void *arg) {
+  Worker *w = arg;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(w->cpu, &set);
+  sched_setaffinity(0, sizeof(set), &set);
+
+  run_round(w, 0);
+  // Free the next thread's blocks, which belong to its node
+  pthread_barrier_wait(&barrier);
+  free_blocks(&workers[(w->id + 1) % n_threads]);
+  pthread_barrier_wait(&barrier);
+  run_round(w, 1);
+  free_blocks(w);
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  int n_cpus = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  n_threads = argc > 1 ? atoi(argv[1]) : n_cpus;
+  size_t mb = argc > 2 ? strtoul(argv[2], NULL, 0) : 32;
+  size_t block_size = argc > 3 ? strtoul(argv[3], NULL, 0) : 4096;
+
+  workers = mallocing(n_threads * sizeof(Worker));
+  memset(workers, 0, n_threads * sizeof(Worker));
+  pthread_barrier_init(&barrier, NULL, n_threads);
+  pthread_t *threads = mallocing(n_threads * sizeof(pthread_t));
+  for (int i = 0; i < n_threads; i++) {
+    workers[i].id = i;
+    workers[i].cpu = i % n_cpus;
+    workers[i].block_size = block_size;
+    workers[i].n_blocks = (mb << 20) / block_size;
+    pthread_create(&threads[i], NULL, worker_main, &workers[i]);
+  }
+  for (int i = 0; i < n_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  printf("%d threads on %d CPUs, %zu MB each in %zu byte blocks\n", n_threads, n_cpus, mb, block_size);
+  printf("%-24s %12s %12s %14s\n", "round", "local pages", "read GB/s", "remote loads");
+  const char *names[2] = {"fresh memory", "after cross-thread free"};
+  for (int round = 0; round < 2; round++) {
+    size_t local = 0, pages = 0;
+    uint64_t read_ns = 0, loads = 0, misses = 0;
+    for (int i = 0; i < n_threads; i++) {
+      local += workers[i].local_pages[round];
+      pages += workers[i].pages[round];
+      read_ns += workers[i].read_ns[round];
+      loads += workers[i].node_loads[round];
+      misses += workers[i].node_misses[round];
+    }
+    double gbps = (double) PASSES * n_threads * (mb << 20) / (read_ns / (double) n_threads);
+    printf("%-24s", names[round]);
+    if (pages > 0) {
+      printf(" %11.1f%%", 100.0 * local / pages);
+    } else {
+      printf(" %12s", "n/a");
+    }
+    printf(" %12.2f", gbps);
+    if (loads > 0) {
+      printf(" %13.1f%%\n", 100.0 * misses / loads);
+    } else {
+      printf(" %14s\n", "n/a");
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,70 @@
+#include "../tests/testing.h"
+#include <stdint.h>
+#include <time.h>
+
+/* Block overhead benchmark, to compare the block formats (make COMPACT=1
+   bench against make bench): for each small size it allocates a million
+   blocks and reports the bytes each takes, metadata and rounding included,
+   as bytes and as overhead on the size requested, the time per
+   my_malloc and per my_free, and the time per operation of random
+   malloc/free churn among them, which walks and splices the free lists.
+
+   Usage: overhead [blocks] */
+
+#define CHURN_OPS 2000000
+
+static const size_t sizes[] = {8, 16, 24, 32, 48, 64, 128};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static unsigned long long rng_state = 88172645463325252ull;
+
+static unsigned long long next_random(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+int main(int argc, char **argv) {
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+  void **blocks = mallocing(n * sizeof(void *));
+
+  printf("%zu byte headers, %zu blocks per size\n", kMetadataSize, n);
+  printf("%6s %10s %10s %10s %10s %10s\n", "size", "block B", "overhead", "malloc ns", "free ns", "churn ns");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    size_t size = sizes[s];
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < n; i++) {
+      blocks[i] = mallocing(size);
+    }
+    double malloc_ns = (double) (now_ns() - start) / n;
+    size_t block_bytes = 0;
+    for (size_t i = 0; i < n; i++) {
+      block_bytes += block_size(ptr_to_block(blocks[i]));
+    }
+
+    start = now_ns();
+    for (size_t i = 0; i < CHURN_OPS; i++) {
+      size_t slot = next_random() % n;
+      freeing(blocks[slot]);
+      blocks[slot] = mallocing(size + next_random() % (size + 1));
+    }
+    double churn_ns = (double) (now_ns() - start) / CHURN_OPS;
+
+    start = now_ns();
+    for (size_t i = 0; i < n; i++) {
+      freeing(blocks[i]);
+    }
+    double free_ns = (double) (now_ns() - start) / n;
+    double per_block = (double) block_bytes / n;
+    printf("%6zu %10.1f %9.0f%% %10.1f %10.1f %10.1f\n", size, per_block, 100 * (per_block - size) / size, malloc_ns,
+           free_ns, churn_ns);
+  }
+  freeing(blocks);
+  return 0;
+}
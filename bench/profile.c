@@ -0,0 +1,129 @@
+#include "../tests/testing.h"
+#include "../src/myprofile.h"
+#include <spawn.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Heap profiler overhead benchmark: runs a malloc/free workload (random
+   replacement in a working set of blocks of 16-4096 bytes) in a child
+   process per sampling period, set with MYMALLOC_PROFILE, and reports the
+   best time per operation of RUNS runs against the run without profiling. With -o the
+   children write their text profiles to <prefix>.<period>.
+
+   Usage: profile [-n operations] [-o prefix] */
+
+#define SLOTS 10000
+#define RUNS 3
+
+extern char **environ;
+
+static const size_t periods[] = {0, 1 << 20, 512 << 10, 64 << 10, 4 << 10, 256};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static unsigned long long rng_state = 88172645463325252ull;
+
+static unsigned long long next_random(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+/* Runs the workload and prints its ns per operation. */
+static void run_child(size_t ops, const char *profile) {
+  static void *slots[SLOTS];
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < ops; i++) {
+    size_t slot = next_random() % SLOTS;
+    freeing(slots[slot]);
+    slots[slot] = mallocing(16 + next_random() % 4081);
+  }
+  double ns = (double) (now_ns() - start) / ops;
+  if (profile != NULL && my_profile_dump(profile, MY_PROFILE_TEXT) != 0) {
+    fprintf(stderr, "cannot write %s\n", profile);
+  }
+  printf("%f\n", ns);
+}
+
+/* Runs the workload in a child with the given sampling period and returns
+   its ns per operation. */
+static double run_period(char *self, size_t ops, size_t period, const char *prefix) {
+  char ops_arg[32], env[64], profile[256];
+  snprintf(ops_arg, sizeof(ops_arg), "%zu", ops);
+  snprintf(env, sizeof(env), "MYMALLOC_PROFILE=%zu", period);
+  snprintf(profile, sizeof(profile), "%s.%zu", prefix != NULL ? prefix : "", period);
+  char *argv[] = {self, "--child", ops_arg, prefix != NULL && period > 0 ? profile : NULL, NULL};
+  char *envp[] = {env, NULL};
+
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return 0;
+  }
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, fds[1], 1);
+  posix_spawn_file_actions_addclose(&actions, fds[0]);
+  pid_t pid;
+  if (posix_spawn(&pid, "/proc/self/exe", &actions, NULL, argv, envp) != 0) {
+    fprintf(stderr, "posix_spawn failed\n");
+    exit(1);
+  }
+  close(fds[1]);
+  char buf[64] = {0};
+  ssize_t len = read(fds[0], buf, sizeof(buf) - 1);
+  close(fds[0]);
+  waitpid(pid, NULL, 0);
+  posix_spawn_file_actions_destroy(&actions);
+  return len > 0 ? strtod(buf, NULL) : 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 2 && strcmp(argv[1], "--child") == 0) {
+    run_child(strtoul(argv[2], NULL, 0), argc > 3 ? argv[3] : NULL);
+    return 0;
+  }
+  size_t ops = 2000000;
+  const char *prefix = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:o:")) != -1) {
+    switch (opt) {
+      case 'n':
+        ops = strtoul(optarg, NULL, 0);
+        break;
+      case 'o':
+        prefix = optarg;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-n operations] [-o prefix]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  printf("%zu malloc/free pairs of 16-4096 bytes\n", ops);
+  printf("%12s %12s %10s\n", "period", "ns/op", "overhead");
+  double base = 0;
+  for (size_t i = 0; i < sizeof(periods) / sizeof(periods[0]); i++) {
+    double ns = 0;
+    for (int run = 0; run < RUNS; run++) {
+      double run_ns = run_period(argv[0], ops, periods[i], prefix);
+      if (run == 0 || run_ns < ns) {
+        ns = run_ns;
+      }
+    }
+    if (periods[i] == 0) {
+      base = ns;
+      printf("%12s %12.1f %10s\n", "off", ns, "-");
+    } else {
+      printf("%12zu %12.1f %9.1f%%\n", periods[i], ns, 100 * (ns - base) / base);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,58 @@
+#include "../tests/testing.h"
+#include <stdint.h>
+#include <time.h>
+
+/* Buffer growth benchmark: grows a buffer from 1 MB to max_mb MB, doubling
+   it and writing the new half each time, as a log buffer or a column being
+   appended to would. It runs once with my_realloc, which remaps huge blocks,
+   and once with the malloc-copy-free a realloc without it has to do, and
+   reports the time spent resizing at each step, not writing.
+
+   Usage: realloc [max_mb] */
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void *copy_realloc(void *ptr, size_t old_size, size_t size) {
+  void *new_ptr = mallocing(size);
+  memcpy(new_ptr, ptr, old_size);
+  freeing(ptr);
+  return new_ptr;
+}
+
+/* Grows the buffer to max_size, and stores the ns each resize takes. */
+static void grow(size_t max_size, int copy, double *ns) {
+  size_t size = 1 << 20;
+  char *buffer = mallocing(size);
+  memset(buffer, 1, size);
+  for (int step = 0; size < max_size; step++) {
+    uint64_t start = now_ns();
+    char *grown = copy ? copy_realloc(buffer, size, 2 * size) : my_realloc(buffer, 2 * size);
+    ns[step] = (double) (now_ns() - start);
+    CHECK_NULL(grown);
+    buffer = grown;
+    memset(buffer + size, 1, size);
+    size *= 2;
+  }
+  freeing(buffer);
+}
+
+int main(int argc, char **argv) {
+  size_t max_mb = argc > 1 ? strtoul(argv[1], NULL, 0) : 2048;
+  double remap_ns[64] = {0}, copy_ns[64] = {0};
+  grow(max_mb << 20, 0, remap_ns);
+  grow(max_mb << 20, 1, copy_ns);
+
+  printf("%10s %14s %14s\n", "size MB", "my_realloc ms", "copy ms");
+  double remap_total = 0, copy_total = 0;
+  for (int step = 0; (2ull << 20 << step) <= max_mb << 20; step++) {
+    printf("%10llu %14.3f %14.3f\n", (2ull << step), remap_ns[step] / 1e6, copy_ns[step] / 1e6);
+    remap_total += remap_ns[step];
+    copy_total += copy_ns[step];
+  }
+  printf("%10s %14.3f %14.3f\n", "total", remap_total / 1e6, copy_total / 1e6);
+  return 0;
+}
@@ -0,0 +1,106 @@
+#include "../tests/testing.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Passive false sharing benchmark, after Hoard's cache-scratch: the main
+   thread allocates one small object per thread and hands them out. Each
+   thread frees its object, then repeatedly allocates an object of the same
+   size, writes every byte of it `writes` times and frees it. An allocator
+   that packs small blocks hands every thread the block the main thread gave
+   it, right next to the other threads' blocks, and their writes fight over
+   the same cache lines.
+
+   It runs once per placement, in a child process each: plain my_malloc,
+   and my_malloc_flags with MY_MALLOC_CACHE_LINE and with MY_MALLOC_PAGE.
+   The false sharing only shows with the threads on different cores.
+
+   Usage: scratch [threads] [iterations] [object_size] [writes] */
+
+typedef struct {
+  char *object;
+  int flags;
+  size_t iterations;
+  size_t size;
+  size_t writes;
+} Worker;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void *worker_main(void *arg) {
+  Worker *w = arg;
+  my_free(w->object);
+  for (size_t i = 0; i < w->iterations; i++) {
+    volatile char *object = my_malloc_flags(w->size, w->flags);
+    for (size_t r = 0; r < w->writes; r++) {
+      for (size_t b = 0; b < w->size; b++) {
+        object[b]++;
+      }
+    }
+    my_free((char *) object);
+  }
+  return NULL;
+}
+
+/* Runs the benchmark and returns its time in ms. */
+static double run(int n_threads, size_t iterations, size_t size, size_t writes, int flags) {
+  Worker *workers = mallocing(n_threads * sizeof(Worker));
+  pthread_t *threads = mallocing(n_threads * sizeof(pthread_t));
+  // Allocated together, as a program's setup would
+  for (int i = 0; i < n_threads; i++) {
+    workers[i] = (Worker) {my_malloc_flags(size, flags), flags, iterations, size, writes};
+  }
+  uint64_t start = now_ns();
+  for (int i = 0; i < n_threads; i++) {
+    pthread_create(&threads[i], NULL, worker_main, &workers[i]);
+  }
+  for (int i = 0; i < n_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  double ms = (now_ns() - start) / 1e6;
+  freeing(threads);
+  freeing(workers);
+  return ms;
+}
+
+int main(int argc, char **argv) {
+  int n_threads = argc > 1 ? atoi(argv[1]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+  size_t iterations = argc > 2 ? strtoul(argv[2], NULL, 0) : 1000;
+  size_t size = argc > 3 ? strtoul(argv[3], NULL, 0) : 8;
+  size_t writes = argc > 4 ? strtoul(argv[4], NULL, 0) : 10000;
+  const char *names[] = {"packed", "cache line", "page"};
+  const int flags[] = {0, MY_MALLOC_CACHE_LINE, MY_MALLOC_PAGE};
+
+  printf("%d threads, %zu iterations of %zu byte objects written %zu times\n", n_threads, iterations, size, writes);
+  printf("%-12s %10s\n", "placement", "ms");
+  for (int i = 0; i < 3; i++) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+      return 1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      double ms = run(n_threads, iterations, size, writes, flags[i]);
+      if (write(fds[1], &ms, sizeof(ms)) != sizeof(ms)) {
+        _exit(1);
+      }
+      _exit(0);
+    }
+    double ms = 0;
+    if (read(fds[0], &ms, sizeof(ms)) != sizeof(ms)) {
+      ms = 0;
+    }
+    waitpid(pid, NULL, 0);
+    close(fds[0]);
+    close(fds[1]);
+    printf("%-12s %10.1f\n", names[i], ms);
+  }
+  return 0;
+}
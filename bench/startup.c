@@ -0,0 +1,92 @@
+#include "../tests/testing.h"
+#include <spawn.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/* Startup benchmark for short-lived processes: the first my_malloc call and a
+   handful of small allocations, as a helper program would make them.
+
+   Without arguments it reports the time of the first my_malloc and of the
+   whole minimal workload, and how much the address space (VmSize) and the
+   resident set (VmRSS) grew. With -n it spawns that many processes running
+   the minimal workload and reports the mean wall time per process.
+
+   Usage: startup [-n processes] */
+
+#define SMALL_ALLOCS 100
+
+extern char **environ;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/* Returns the value in kB of a field of /proc/self/status, or 0. */
+static size_t status_kb(const char *field) {
+  char line[256];
+  size_t kb = 0;
+  FILE *f = fopen("/proc/self/status", "r");
+  if (f == NULL) {
+    return 0;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (strncmp(line, field, strlen(field)) == 0) {
+      kb = strtoul(line + strlen(field) + 1, NULL, 10);
+      break;
+    }
+  }
+  fclose(f);
+  return kb;
+}
+
+static void minimal_workload(void) {
+  void *ptrs[SMALL_ALLOCS];
+  for (int i = 0; i < SMALL_ALLOCS; i++) {
+    ptrs[i] = mallocing(16 + (i % 8) * 16);
+    memset(ptrs[i], 0, 16);
+  }
+  for (int i = 0; i < SMALL_ALLOCS; i++) {
+    freeing(ptrs[i]);
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && strcmp(argv[1], "--child") == 0) {
+    minimal_workload();
+    return 0;
+  }
+  if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+    int n = atoi(argv[2]);
+    char *child_argv[] = {argv[0], "--child", NULL};
+    uint64_t start = now_ns();
+    for (int i = 0; i < n; i++) {
+      pid_t pid;
+      if (posix_spawn(&pid, "/proc/self/exe", NULL, NULL, child_argv, environ) != 0) {
+        fprintf(stderr, "posix_spawn failed\n");
+        return 1;
+      }
+      waitpid(pid, NULL, 0);
+    }
+    printf("processes: %d, %.1fus per process\n", n, (now_ns() - start) / 1e3 / n);
+    return 0;
+  }
+
+  size_t vm_before = status_kb("VmSize"), rss_before = status_kb("VmRSS");
+  uint64_t start = now_ns();
+  void *first = mallocing(16);
+  uint64_t first_ns = now_ns() - start;
+  minimal_workload();
+  uint64_t total_ns = now_ns() - start;
+  size_t vm_after = status_kb("VmSize"), rss_after = status_kb("VmRSS");
+  freeing(first);
+
+  printf("first my_malloc:   %llu ns\n", (unsigned long long) first_ns);
+  printf("minimal workload:  %llu ns\n", (unsigned long long) total_ns);
+  printf("VmSize growth:     %zu kB\n", vm_after - vm_before);
+  printf("VmRSS growth:      %zu kB\n", rss_after - rss_before);
+  return 0;
+}
@@ -0,0 +1,141 @@
+#include "../tests/testing.h"
+#include "../src/mystream.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Streaming copy and zero benchmark. First the operations themselves: GB/s
+   of memcpy against my_stream_copy and memset against my_stream_zero, over
+   block sizes around the cache sizes. Then their effect on a cache sensitive
+   workload: a thread chasing pointers around a working set of ws_kb KB
+   reports its ns per step alone, and while another thread keeps copying or
+   zeroing 64 MB blocks with regular and with streaming stores. With the
+   threads on one CPU they take turns, and what is measured is how much of
+   the working set each turn of the copy leaves in the cache.
+
+   Usage: stream [ws_kb] [seconds] */
+
+#define BIG_SIZE (64ull << 20)
+
+static const size_t sizes[] = {64 << 10, 256 << 10, 1 << 20, 4 << 20, 16 << 20, 64 << 20};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void plain_copy(void *dst, const void *src, size_t n) {
+  memcpy(dst, src, n);
+}
+
+static void plain_zero(void *dst, size_t n) {
+  memset(dst, 0, n);
+}
+
+static char *big_src, *big_dst;
+
+/* Returns the GB/s of a copy (or zero, with src NULL) of n bytes. */
+static double bandwidth(void (*copy)(void *, const void *, size_t), void (*zero)(void *, size_t), size_t n) {
+  size_t reps = (1ull << 30) / n;
+  uint64_t start = now_ns();
+  for (size_t r = 0; r < reps; r++) {
+    if (copy != NULL) {
+      copy(big_dst, big_src, n);
+    } else {
+      zero(big_dst, n);
+    }
+  }
+  return (double) reps * n / (now_ns() - start);
+}
+
+typedef struct {
+  void (*copy)(void *, const void *, size_t);
+  void (*zero)(void *, size_t);
+  volatile int stop;
+} Disturber;
+
+static void *disturb(void *arg) {
+  Disturber *d = arg;
+  while (!d->stop) {
+    if (d->copy != NULL) {
+      d->copy(big_dst, big_src, BIG_SIZE);
+    } else {
+      d->zero(big_dst, BIG_SIZE);
+    }
+  }
+  return NULL;
+}
+
+static size_t *chain;
+
+/* Returns the ns per step of the pointer chase, run for `seconds`. */
+static double chase(double seconds) {
+  size_t steps = 0, at = 0;
+  uint64_t start = now_ns(), end = start + (uint64_t) (seconds * 1e9);
+  uint64_t t = start;
+  while (t < end) {
+    for (int i = 0; i < 100000; i++) {
+      at = chain[at];
+    }
+    steps += 100000;
+    t = now_ns();
+  }
+  // Keeps the chase from being optimised out
+  if (at == (size_t) -1) {
+    printf("\n");
+  }
+  return (double) (t - start) / steps;
+}
+
+int main(int argc, char **argv) {
+  size_t ws = (argc > 1 ? strtoul(argv[1], NULL, 0) : 1024) << 10;
+  double seconds = argc > 2 ? atof(argv[2]) : 2;
+  big_src = mallocing(BIG_SIZE);
+  big_dst = mallocing(BIG_SIZE);
+  memset(big_src, 1, BIG_SIZE);
+  memset(big_dst, 1, BIG_SIZE);
+
+  printf("streaming threshold %zu bytes\n", my_stream_threshold);
+  printf("%10s %12s %12s %12s %12s\n", "size KB", "memcpy GB/s", "stream GB/s", "memset GB/s", "stream GB/s");
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    size_t n = sizes[i];
+    printf("%10zu %12.2f %12.2f %12.2f %12.2f\n", n >> 10, bandwidth(plain_copy, NULL, n),
+           bandwidth(my_stream_copy, NULL, n), bandwidth(NULL, plain_zero, n), bandwidth(NULL, my_stream_zero, n));
+  }
+
+  // A random cycle through the working set, one step per cache line
+  size_t lines = ws / 64, stride = 64 / sizeof(size_t);
+  chain = mallocing(ws);
+  size_t *order = mallocing(lines * sizeof(size_t));
+  for (size_t i = 0; i < lines; i++) {
+    order[i] = i;
+  }
+  srand(1);
+  for (size_t i = lines - 1; i > 0; i--) {
+    size_t j = (size_t) rand() % (i + 1), tmp = order[i];
+    order[i] = order[j];
+    order[j] = tmp;
+  }
+  for (size_t i = 0; i < lines; i++) {
+    chain[order[i] * stride] = order[(i + 1) % lines] * stride;
+  }
+  freeing(order);
+
+  printf("\npointer chase over %zu KB, ns per step\n", ws >> 10);
+  printf("%-16s %10.2f\n", "alone", chase(seconds));
+  const char *names[] = {"memcpy", "my_stream_copy", "memset", "my_stream_zero"};
+  Disturber disturbers[] = {{plain_copy, NULL}, {my_stream_copy, NULL}, {NULL, plain_zero}, {NULL, my_stream_zero}};
+  for (int i = 0; i < 4; i++) {
+    pthread_t thread;
+    pthread_create(&thread, NULL, disturb, &disturbers[i]);
+    double ns = chase(seconds);
+    disturbers[i].stop = 1;
+    pthread_join(thread, NULL);
+    printf("%-16s %10.2f\n", names[i], ns);
+  }
+  freeing(chain);
+  freeing(big_src);
+  freeing(big_dst);
+  return 0;
+}
@@ -0,0 +1,778 @@
+#include "../tests/testing.h"
+#include "counters.h"
+#include <stdint.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Application workloads: single threaded programs in miniature, in place of
+   the same-size blocks of bench/benchmark.
+     json      builds JSON documents (objects, arrays grown with realloc,
+               strings and numbers) and frees each one after the next
+     tokens    splits text into token strings, collected in an array grown
+               with realloc, and keeps some of them in a symbol table
+     hash      fills a chained hash table, which doubles its buckets as it
+               grows, and empties it again
+     rbtree    inserts and erases random keys in a red-black tree of
+               64K nodes, each with a value string
+     lru       a cache of values of 32 bytes to 2 KB under a 4 MB budget,
+               read with skewed keys, which loads misses and evicts the
+               least recently used values
+   Each runs once with my_malloc/my_realloc/my_free and once with glibc,
+   each in a child process of its own so it starts from a fresh heap, and
+   reports its operations per second and peak footprint: the growth of the
+   child's resident memory (VmHWM) over what it had at the start. Event
+   counts of each run follow the table (see counters.h).
+
+   Usage: workloads [scale] [workload|allocator...], all of them if none
+   is named */
+
+typedef struct {
+  const char *name;
+  void *(*malloc)(size_t size);
+  void *(*realloc)(void *ptr, size_t size);
+  void (*free)(void *ptr);
+} Allocator;
+
+static const Allocator allocators[] = {
+    {"my_malloc", my_malloc, my_realloc, my_free},
+    {"glibc", malloc, realloc, free},
+};
+
+static const Allocator *allocator;
+// Folds in what the workloads read, so none of it is optimised out
+static volatile uint64_t sink;
+
+static void *alloc(size_t size) {
+  void *ptr = allocator->malloc(size);
+  CHECK_NULL(ptr);
+  return ptr;
+}
+
+static void *resize(void *ptr, size_t size) {
+  ptr = allocator->realloc(ptr, size);
+  CHECK_NULL(ptr);
+  return ptr;
+}
+
+static void release(void *ptr) {
+  allocator->free(ptr);
+}
+
+static char *copy_string(const char *s, size_t length) {
+  char *copy = alloc(length + 1);
+  memcpy(copy, s, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static unsigned long long rng_state = 88172645463325252ull;
+
+static uint64_t next_random(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+static char random_text[64];
+
+/* Returns `length` characters of random text, not terminated. */
+static const char *random_chars(size_t length) {
+  size_t offset = next_random() % (sizeof(random_text) - length);
+  return random_text + offset;
+}
+
+/* ============================== JSON DOM ================================= */
+
+enum { JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+
+typedef struct JsonValue {
+  int type;
+  union {
+    double number;
+    char *string;
+    struct {
+      struct JsonValue **items;
+      // Only for objects, one key per item
+      char **keys;
+      size_t count;
+      size_t capacity;
+    } container;
+  };
+} JsonValue;
+
+// Nodes left to build in the current document
+static size_t json_budget;
+
+static JsonValue *json_build(int depth) {
+  JsonValue *value = alloc(sizeof(JsonValue));
+  json_budget--;
+  if (depth < 6 && json_budget > 0 && next_random() % 3 != 0) {
+    value->type = next_random() % 2 ? JSON_ARRAY : JSON_OBJECT;
+    value->container.items = NULL;
+    value->container.keys = NULL;
+    value->container.count = 0;
+    value->container.capacity = 0;
+    size_t children = 1 + next_random() % 12;
+    for (size_t i = 0; i < children && json_budget > 0; i++) {
+      if (value->container.count == value->container.capacity) {
+        value->container.capacity = value->container.capacity ? 2 * value->container.capacity : 2;
+        value->container.items = resize(value->container.items, value->container.capacity * sizeof(JsonValue *));
+        if (value->type == JSON_OBJECT) {
+          value->container.keys = resize(value->container.keys, value->container.capacity * sizeof(char *));
+        }
+      }
+      if (value->type == JSON_OBJECT) {
+        size_t length = 3 + next_random() % 14;
+        value->container.keys[value->container.count] = copy_string(random_chars(length), length);
+      }
+      value->container.items[value->container.count++] = json_build(depth + 1);
+    }
+  } else if (next_random() % 2) {
+    value->type = JSON_NUMBER;
+    value->number = (double) next_random();
+  } else {
+    value->type = JSON_STRING;
+    size_t length = 1 + next_random() % 40;
+    value->string = copy_string(random_chars(length), length);
+  }
+  return value;
+}
+
+static uint64_t json_free(JsonValue *value) {
+  uint64_t nodes = 1;
+  if (value->type == JSON_STRING) {
+    release(value->string);
+  } else if (value->type != JSON_NUMBER) {
+    for (size_t i = 0; i < value->container.count; i++) {
+      nodes += json_free(value->container.items[i]);
+      if (value->type == JSON_OBJECT) {
+        release(value->container.keys[i]);
+      }
+    }
+    release(value->container.items);
+    release(value->container.keys);
+  }
+  release(value);
+  return nodes;
+}
+
+/* Returns the number of nodes built. */
+static uint64_t run_json(size_t scale) {
+  JsonValue *previous = NULL;
+  uint64_t nodes = 0;
+  for (size_t round = 0; round < 200 * scale; round++) {
+    // Documents of up to 20000 nodes, one as deep as the budget allows
+    json_budget = 20000;
+    JsonValue *document = json_build(0);
+    if (previous != NULL) {
+      nodes += json_free(previous);
+    }
+    previous = document;
+  }
+  nodes += json_free(previous);
+  return nodes;
+}
+
+/* ============================= Tokeniser ================================= */
+
+#define TEXT_SIZE (1 << 20)
+#define SYMBOLS 4096
+
+static char text[TEXT_SIZE];
+
+static void make_text(void) {
+  static const char separators[] = " \n\t,;(){}=+";
+  size_t i = 0;
+  while (i < TEXT_SIZE - 1) {
+    size_t length = 1 + next_random() % 12 + (next_random() % 16 == 0 ? next_random() % 48 : 0);
+    for (size_t j = 0; j < length && i < TEXT_SIZE - 1; j++) {
+      text[i++] = 'a' + next_random() % 26;
+    }
+    if (i < TEXT_SIZE - 1) {
+      text[i++] = separators[next_random() % (sizeof(separators) - 1)];
+    }
+  }
+  text[TEXT_SIZE - 1] = '\0';
+}
+
+static int is_separator(char c) {
+  return c < 'a' || c > 'z';
+}
+
+/* Returns the number of tokens. */
+static uint64_t run_tokens(size_t scale) {
+  char **symbols = alloc(SYMBOLS * sizeof(char *));
+  memset(symbols, 0, SYMBOLS * sizeof(char *));
+  uint64_t tokens = 0;
+  // Documents of 64 KB of the text, each tokenised into an array of its own
+  const size_t document_size = 64 << 10;
+  for (size_t round = 0; round < 10 * scale; round++) {
+    for (size_t start = 0; start + document_size <= TEXT_SIZE; start += document_size) {
+      char **array = NULL;
+      size_t count = 0;
+      size_t capacity = 0;
+      size_t i = start;
+      while (i < start + document_size) {
+        while (i < start + document_size && is_separator(text[i])) {
+          i++;
+        }
+        size_t begin = i;
+        while (i < start + document_size && !is_separator(text[i])) {
+          i++;
+        }
+        if (i == begin) {
+          break;
+        }
+        if (count == capacity) {
+          capacity = capacity ? 2 * capacity : 16;
+          array = resize(array, capacity * sizeof(char *));
+        }
+        array[count++] = copy_string(text + begin, i - begin);
+      }
+      for (size_t t = 0; t < count; t++) {
+        sink += array[t][0];
+        // Some tokens outlive their document, as identifiers would
+        if (next_random() % 16 == 0) {
+          size_t slot = next_random() % SYMBOLS;
+          if (symbols[slot] != NULL) {
+            release(symbols[slot]);
+          }
+          symbols[slot] = array[t];
+        } else {
+          release(array[t]);
+        }
+      }
+      release(array);
+      tokens += count;
+    }
+  }
+  for (size_t s = 0; s < SYMBOLS; s++) {
+    if (symbols[s] != NULL) {
+      release(symbols[s]);
+    }
+  }
+  release(symbols);
+  return tokens;
+}
+
+/* ========================== Hash table resize ============================ */
+
+typedef struct HashNode {
+  uint64_t key;
+  uint64_t value;
+  struct HashNode *next;
+} HashNode;
+
+typedef struct {
+  HashNode **buckets;
+  size_t bucket_count;
+  size_t size;
+} HashTable;
+
+static uint64_t hash(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdull;
+  key ^= key >> 33;
+  return key;
+}
+
+static HashNode **new_buckets(size_t count) {
+  HashNode **buckets = alloc(count * sizeof(HashNode *));
+  memset(buckets, 0, count * sizeof(HashNode *));
+  return buckets;
+}
+
+static void hash_insert(HashTable *table, uint64_t key) {
+  if (table->size == table->bucket_count) {
+    size_t count = 2 * table->bucket_count;
+    HashNode **buckets = new_buckets(count);
+    for (size_t b = 0; b < table->bucket_count; b++) {
+      HashNode *node = table->buckets[b];
+      while (node != NULL) {
+        HashNode *next = node->next;
+        size_t index = hash(node->key) & (count - 1);
+        node->next = buckets[index];
+        buckets[index] = node;
+        node = next;
+      }
+    }
+    release(table->buckets);
+    table->buckets = buckets;
+    table->bucket_count = count;
+  }
+  HashNode *node = alloc(sizeof(HashNode));
+  size_t index = hash(key) & (table->bucket_count - 1);
+  node->key = key;
+  node->value = key * 3;
+  node->next = table->buckets[index];
+  table->buckets[index] = node;
+  table->size++;
+}
+
+static void hash_erase(HashTable *table, uint64_t key) {
+  HashNode **link = &table->buckets[hash(key) & (table->bucket_count - 1)];
+  while (*link != NULL && (*link)->key != key) {
+    link = &(*link)->next;
+  }
+  if (*link != NULL) {
+    HashNode *node = *link;
+    *link = node->next;
+    sink += node->value;
+    release(node);
+    table->size--;
+  }
+}
+
+/* Returns the number of inserts and erases. */
+static uint64_t run_hash(size_t scale) {
+  const size_t keys = 1 << 17;
+  uint64_t ops = 0;
+  for (size_t round = 0; round < 20 * scale; round++) {
+    HashTable table = {new_buckets(16), 16, 0};
+    uint64_t seed = next_random();
+    for (size_t i = 0; i < keys; i++) {
+      hash_insert(&table, hash(seed + i));
+    }
+    for (size_t i = 0; i < keys; i++) {
+      hash_erase(&table, hash(seed + i));
+    }
+    release(table.buckets);
+    ops += 2 * keys;
+  }
+  return ops;
+}
+
+/* ============================ Red-black tree ============================= */
+
+/* Left-leaning red-black tree (Sedgewick), with a value string per node. */
+typedef struct RbNode {
+  uint64_t key;
+  char *value;
+  struct RbNode *left;
+  struct RbNode *right;
+  int red;
+} RbNode;
+
+static int is_red(RbNode *node) {
+  return node != NULL && node->red;
+}
+
+static RbNode *rotate_left(RbNode *h) {
+  RbNode *x = h->right;
+  h->right = x->left;
+  x->left = h;
+  x->red = h->red;
+  h->red = 1;
+  return x;
+}
+
+static RbNode *rotate_right(RbNode *h) {
+  RbNode *x = h->left;
+  h->left = x->right;
+  x->right = h;
+  x->red = h->red;
+  h->red = 1;
+  return x;
+}
+
+static void flip_colors(RbNode *h) {
+  h->red = !h->red;
+  h->left->red = !h->left->red;
+  h->right->red = !h->right->red;
+}
+
+static RbNode *fix_up(RbNode *h) {
+  if (is_red(h->right) && !is_red(h->left)) {
+    h = rotate_left(h);
+  }
+  if (is_red(h->left) && is_red(h->left->left)) {
+    h = rotate_right(h);
+  }
+  if (is_red(h->left) && is_red(h->right)) {
+    flip_colors(h);
+  }
+  return h;
+}
+
+static RbNode *rb_insert(RbNode *h, uint64_t key) {
+  if (h == NULL) {
+    RbNode *node = alloc(sizeof(RbNode));
+    size_t length = 8 + key % 56;
+    node->key = key;
+    node->value = copy_string(random_chars(length), length);
+    node->left = node->right = NULL;
+    node->red = 1;
+    return node;
+  }
+  if (key < h->key) {
+    h->left = rb_insert(h->left, key);
+  } else if (key > h->key) {
+    h->right = rb_insert(h->right, key);
+  }
+  return fix_up(h);
+}
+
+static RbNode *move_red_left(RbNode *h) {
+  flip_colors(h);
+  if (is_red(h->right->left)) {
+    h->right = rotate_right(h->right);
+    h = rotate_left(h);
+    flip_colors(h);
+  }
+  return h;
+}
+
+static RbNode *move_red_right(RbNode *h) {
+  flip_colors(h);
+  if (is_red(h->left->left)) {
+    h = rotate_right(h);
+    flip_colors(h);
+  }
+  return h;
+}
+
+/* Unlinks the smallest node of a subtree into `*min`. */
+static RbNode *rb_take_min(RbNode *h, RbNode **min) {
+  if (h->left == NULL) {
+    *min = h;
+    return NULL;
+  }
+  if (!is_red(h->left) && !is_red(h->left->left)) {
+    h = move_red_left(h);
+  }
+  h->left = rb_take_min(h->left, min);
+  return fix_up(h);
+}
+
+/* Erases `key`, which must be in the tree. */
+static RbNode *rb_erase(RbNode *h, uint64_t key) {
+  if (key < h->key) {
+    if (!is_red(h->left) && !is_red(h->left->left)) {
+      h = move_red_left(h);
+    }
+    h->left = rb_erase(h->left, key);
+  } else {
+    if (is_red(h->left)) {
+      h = rotate_right(h);
+    }
+    if (key == h->key && h->right == NULL) {
+      release(h->value);
+      release(h);
+      return NULL;
+    }
+    if (!is_red(h->right) && !is_red(h->right->left)) {
+      h = move_red_right(h);
+    }
+    if (key == h->key) {
+      RbNode *min;
+      h->right = rb_take_min(h->right, &min);
+      release(h->value);
+      h->key = min->key;
+      h->value = min->value;
+      release(min);
+    } else {
+      h->right = rb_erase(h->right, key);
+    }
+  }
+  return fix_up(h);
+}
+
+static int rb_contains(RbNode *h, uint64_t key) {
+  while (h != NULL && h->key != key) {
+    h = key < h->key ? h->left : h->right;
+  }
+  return h != NULL;
+}
+
+static RbNode *rb_insert_root(RbNode *root, uint64_t key) {
+  root = rb_insert(root, key);
+  root->red = 0;
+  return root;
+}
+
+static RbNode *rb_erase_root(RbNode *root, uint64_t key) {
+  if (!is_red(root->left) && !is_red(root->right)) {
+    root->red = 1;
+  }
+  root = rb_erase(root, key);
+  if (root != NULL) {
+    root->red = 0;
+  }
+  return root;
+}
+
+static void rb_free(RbNode *h) {
+  if (h != NULL) {
+    rb_free(h->left);
+    rb_free(h->right);
+    release(h->value);
+    release(h);
+  }
+}
+
+/* Returns the number of inserts and erases tried. */
+static uint64_t run_rbtree(size_t scale) {
+  // Keys from twice the steady state size, so half of the operations hit
+  const uint64_t key_range = 1 << 17;
+  RbNode *root = NULL;
+  for (uint64_t i = 0; i < key_range / 2; i++) {
+    root = rb_insert_root(root, next_random() % key_range);
+  }
+  uint64_t ops = 2000000 * scale;
+  for (uint64_t i = 0; i < ops; i++) {
+    uint64_t key = next_random() % key_range;
+    if (next_random() % 2) {
+      root = rb_insert_root(root, key);
+    } else if (rb_contains(root, key)) {
+      root = rb_erase_root(root, key);
+    }
+  }
+  rb_free(root);
+  return ops;
+}
+
+/* ============================== LRU cache ================================ */
+
+#define LRU_BUDGET (4 << 20)
+#define LRU_BUCKETS (1 << 14)
+
+typedef struct LruEntry {
+  uint64_t key;
+  char *value;
+  size_t size;
+  struct LruEntry *hash_next;
+  // Most recently used first
+  struct LruEntry *prev;
+  struct LruEntry *next;
+} LruEntry;
+
+typedef struct {
+  LruEntry **buckets;
+  LruEntry *head;
+  LruEntry *tail;
+  size_t bytes;
+} LruCache;
+
+static void lru_unlink(LruCache *cache, LruEntry *entry) {
+  if (entry->prev != NULL) {
+    entry->prev->next = entry->next;
+  } else {
+    cache->head = entry->next;
+  }
+  if (entry->next != NULL) {
+    entry->next->prev = entry->prev;
+  } else {
+    cache->tail = entry->prev;
+  }
+}
+
+static void lru_push_front(LruCache *cache, LruEntry *entry) {
+  entry->prev = NULL;
+  entry->next = cache->head;
+  if (cache->head != NULL) {
+    cache->head->prev = entry;
+  } else {
+    cache->tail = entry;
+  }
+  cache->head = entry;
+}
+
+static void lru_evict(LruCache *cache) {
+  LruEntry *entry = cache->tail;
+  LruEntry **link = &cache->buckets[hash(entry->key) & (LRU_BUCKETS - 1)];
+  while (*link != entry) {
+    link = &(*link)->hash_next;
+  }
+  *link = entry->hash_next;
+  lru_unlink(cache, entry);
+  cache->bytes -= entry->size;
+  release(entry->value);
+  release(entry);
+}
+
+/* Returns 1 on a hit, and loads the value on a miss. */
+static int lru_get(LruCache *cache, uint64_t key) {
+  LruEntry **bucket = &cache->buckets[hash(key) & (LRU_BUCKETS - 1)];
+  for (LruEntry *entry = *bucket; entry != NULL; entry = entry->hash_next) {
+    if (entry->key == key) {
+      sink += entry->value[0];
+      lru_unlink(cache, entry);
+      lru_push_front(cache, entry);
+      return 1;
+    }
+  }
+  // Mostly small values, some large, the same size for the same key
+  uint64_t h = hash(key);
+  size_t size = h % 8 == 0 ? 512 + h % 1537 : 32 + h % 225;
+  while (cache->bytes + size > LRU_BUDGET) {
+    lru_evict(cache);
+  }
+  LruEntry *entry = alloc(sizeof(LruEntry));
+  entry->key = key;
+  entry->value = alloc(size);
+  memset(entry->value, (int) key, size);
+  entry->size = size;
+  entry->hash_next = *bucket;
+  *bucket = entry;
+  lru_push_front(cache, entry);
+  cache->bytes += size;
+  return 0;
+}
+
+/* Returns the number of reads. */
+static uint64_t run_lru(size_t scale) {
+  LruCache cache = {alloc(LRU_BUCKETS * sizeof(LruEntry *)), NULL, NULL, 0};
+  memset(cache.buckets, 0, LRU_BUCKETS * sizeof(LruEntry *));
+  const uint64_t key_range = 1 << 20;
+  uint64_t ops = 2000000 * scale;
+  uint64_t hits = 0;
+  for (uint64_t i = 0; i < ops; i++) {
+    // Skewed towards small keys
+    uint64_t key = next_random() % (next_random() % key_range + 1);
+    hits += lru_get(&cache, key);
+  }
+  sink += hits;
+  while (cache.tail != NULL) {
+    lru_evict(&cache);
+  }
+  release(cache.buckets);
+  return ops;
+}
+
+/* ================================ Driver ================================= */
+
+static const struct {
+  const char *name;
+  uint64_t (*run)(size_t scale);
+  const char *unit;
+} workloads[] = {
+    {"json", run_json, "nodes"},
+    {"tokens", run_tokens, "tokens"},
+    {"hash", run_hash, "ops"},
+    {"rbtree", run_rbtree, "ops"},
+    {"lru", run_lru, "reads"},
+};
+
+#define WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+/* Returns a field of /proc/self/status in KB, or 0. */
+static size_t status_kb(const char *field) {
+  FILE *f = fopen("/proc/self/status", "r");
+  if (f == NULL) {
+    return 0;
+  }
+  char line[256];
+  size_t kb = 0;
+  size_t length = strlen(field);
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (strncmp(line, field, length) == 0 && line[length] == ':') {
+      kb = strtoul(line + length + 1, NULL, 10);
+      break;
+    }
+  }
+  fclose(f);
+  return kb;
+}
+
+/* Runs a workload with an allocator in a child process and prints its row,
+   and its event counts to `counts`. */
+static void run(size_t w, const Allocator *a, size_t scale, FILE *counts) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid != 0) {
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      printf("%-8s %-10s %10s\n", workloads[w].name, a->name, "failed");
+    }
+    return;
+  }
+  allocator = a;
+  // Resets VmHWM to the current resident size, where the kernel allows it
+  FILE *clear_refs = fopen("/proc/self/clear_refs", "w");
+  if (clear_refs != NULL) {
+    fputs("5", clear_refs);
+    fclose(clear_refs);
+  }
+  size_t start_kb = status_kb("VmRSS");
+  Counters counters;
+  counters_open(&counters);
+  uint64_t start = now_ns();
+  counters_start(&counters);
+  uint64_t ops = workloads[w].run(scale);
+  counters_stop(&counters);
+  double seconds = (double) (now_ns() - start) / 1e9;
+  size_t peak_kb = status_kb("VmHWM");
+  double footprint_mb = peak_kb > start_kb ? (double) (peak_kb - start_kb) / 1024 : 0;
+  printf("%-8s %-10s %10.2f %10.1f %8s %12.1f\n", workloads[w].name, a->name, ops / seconds / 1e6,
+         seconds * 1e9 / ops, workloads[w].unit, footprint_mb);
+  char label[64];
+  snprintf(label, sizeof(label), "%s/%s", workloads[w].name, a->name);
+  counters_print(counts, &counters, label, ops);
+  exit(0);
+}
+
+/* Whether `name` is among the names of its kind in argv[2..], or none of
+   them is. */
+static int selected(const char *name, const char *const *names, size_t count, int argc, char **argv) {
+  int any = 0;
+  for (int i = 2; i < argc; i++) {
+    for (size_t n = 0; n < count; n++) {
+      if (strcmp(argv[i], names[n]) == 0) {
+        any = 1;
+        if (strcmp(argv[i], name) == 0) {
+          return 1;
+        }
+      }
+    }
+  }
+  return !any;
+}
+
+int main(int argc, char **argv) {
+  size_t scale = argc > 1 ? strtoul(argv[1], NULL, 0) : 1;
+  const char *workload_names[WORKLOADS];
+  for (size_t w = 0; w < WORKLOADS; w++) {
+    workload_names[w] = workloads[w].name;
+  }
+  const char *allocator_names[] = {allocators[0].name, allocators[1].name};
+  for (size_t i = 0; i < sizeof(random_text); i++) {
+    random_text[i] = 'a' + next_random() % 26;
+  }
+  make_text();
+
+  // The children's event counts, printed after the table
+  FILE *counts = tmpfile();
+  if (counts == NULL) {
+    counts = stdout;
+  }
+  printf("scale %zu, throughput in millions of operations per second\n", scale);
+  printf("%-8s %-10s %10s %10s %8s %12s\n", "workload", "allocator", "Mops", "ns/op", "op", "footprint MB");
+  for (size_t w = 0; w < WORKLOADS; w++) {
+    if (!selected(workloads[w].name, workload_names, WORKLOADS, argc, argv)) {
+      continue;
+    }
+    for (size_t a = 0; a < 2; a++) {
+      if (selected(allocators[a].name, allocator_names, 2, argc, argv)) {
+        run(w, &allocators[a], scale, counts);
+      }
+    }
+  }
+  if (counts != stdout) {
+    char line[1024];
+    rewind(counts);
+    while (fgets(line, sizeof(line), counts) != NULL) {
+      fputs(line, stdout);
+    }
+  }
+  return 0;
+}
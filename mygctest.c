@@ -1,14 +1,37 @@
 #include "src/mygc.h"
 #include <string.h>
 
-/** This is a template file for you to use for testing your garbage collector
- *  implementation. 
- *  It is up to you to determine how to effectively test your GC code.
- * 
- *  If you are not planning on implementing the garbage collector you may ignore
- *  this file.
+/** Tests for the garbage collector. Build and run with
+ *    make gctest MALLOC=mygc && ./mygctest
+ *
+ *  The collector is conservative, so stale copies of a pointer left in dead
+ *  stack frames can keep a block alive. Tests allocate their garbage in
+ *  separate (noinline) functions and wipe the dead part of the stack with
+ *  `clear_stack` before collecting. Stale words can still hide in padding of
+ *  live frames, so counts of freed blocks allow for a few of those.
  */
 
+// Blocks that may be retained by stale words in live frames
+#define SLACK 4
+
+#define CHECK(cond)                                                    \
+  do {                                                                 \
+    if (!(cond)) {                                                     \
+      fprintf(stderr, "[%s:%d] check failed: %s\n", __FILE__, __LINE__, \
+              #cond);                                                  \
+      exit(1);                                                         \
+    }                                                                  \
+  } while (0)
+
+typedef struct Node Node;
+struct Node {
+  Node *next;
+  size_t value;
+};
+
+// Reachable through the data segment
+static Node *global_list = NULL;
+
 // Version of your malloc that clears the block returned by malloc. To make sure when testing
 // that there aren't random values in the blocks which just so happen to be pointers to other blocks.
 void *my_calloc_gc(size_t size) {
@@ -17,15 +40,269 @@ void *my_calloc_gc(size_t size) {
   return p;
 }
 
+__attribute__((noinline, no_sanitize_address)) static void clear_stack(void) {
+  volatile char buf[16384];
+  memset((char *) buf, 0, sizeof(buf));
+}
+
+static size_t live_blocks(void) {
+  // Initialised so no stale pointers sit in it while collecting
+  struct GCStats stats = {0};
+  clear_stack();
+  my_gc();
+  my_gc_get_stats(&stats);
+  return stats.live_blocks;
+}
+
+__attribute__((noinline)) static Node *make_list(size_t n) {
+  Node *head = NULL;
+  for (size_t i = 0; i < n; i++) {
+    Node *node = my_calloc_gc(sizeof(Node));
+    node->next = head;
+    node->value = i;
+    head = node;
+  }
+  return head;
+}
+
+__attribute__((noinline)) static void make_garbage(size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    my_calloc_gc(16 + (i % 64) * 8);
+  }
+}
+
+static void test_unreachable_freed(void) {
+  size_t before = live_blocks();
+  make_garbage(1000);
+  CHECK(live_blocks() <= before + SLACK);
+}
+
+/* Keeps one list reachable from the data segment and one from this frame. */
+__attribute__((noinline)) static void check_lists_kept(size_t before) {
+  global_list = make_list(1000);
+  Node *local_list = make_list(500);
+  make_garbage(1000);
+  CHECK(live_blocks() >= before + 1500);
+  CHECK(live_blocks() <= before + 1500 + SLACK);
+
+  size_t n = 0;
+  for (Node *node = global_list; node != NULL; node = node->next) {
+    CHECK(node->value == 999 - n);
+    n++;
+  }
+  CHECK(n == 1000);
+  n = 0;
+  for (Node *node = local_list; node != NULL; node = node->next) {
+    n++;
+  }
+  CHECK(n == 500);
+}
+
+static void test_reachable_kept(void) {
+  size_t before = live_blocks();
+  check_lists_kept(before);
+  global_list = NULL;
+  CHECK(live_blocks() <= before + SLACK);
+}
+
+static void test_interior_pointer(void) {
+  size_t before = live_blocks();
+  char *interior = (char *) my_calloc_gc(4096) + 2000;
+  CHECK(live_blocks() >= before + 1);
+  interior[0] = 1;
+  interior = NULL;
+  CHECK(live_blocks() <= before + SLACK);
+}
+
+static void test_memory_reused(void) {
+  struct GCStats stats = {0};
+  make_garbage(10000);
+  clear_stack();
+  my_gc();
+  my_gc_get_stats(&stats);
+  size_t heap_size = stats.heap_size;
+  CHECK(stats.freed_bytes > 0);
+  for (int i = 0; i < 10; i++) {
+    make_garbage(10000);
+    clear_stack();
+    my_gc();
+  }
+  my_gc_get_stats(&stats);
+  CHECK(stats.heap_size == heap_size);
+}
+
+/* Moves the list after its `n`th node into `holder`. */
+__attribute__((noinline)) static void move_tail(Node *holder, size_t n) {
+  Node *prev = global_list;
+  for (size_t i = 0; i < n; i++) {
+    prev = prev->next;
+  }
+  my_gc_write_barrier((void **) &holder->next, prev->next);
+  prev->next = NULL;
+}
+
+/* Moves the tail of a list into a block that was already scanned while an
+   incremental cycle is marking, then checks nothing of it was freed by
+   overwriting the free memory with garbage. */
+__attribute__((noinline)) static void check_incremental(void) {
+  struct GCStats stats = {0};
+  Node *holder = my_calloc_gc(sizeof(Node));
+  global_list = make_list(1000);
+  global_list->value = (size_t) holder;
+
+  int steps = 0;
+  while (!my_gc_step(1024)) {
+    if (++steps == 3) {
+      move_tail(holder, 900);
+      clear_stack();
+    }
+    make_garbage(10);
+  }
+  CHECK(steps > 3);
+  make_garbage(10000);
+
+  size_t n = 0;
+  for (Node *node = holder->next, *next; node != NULL; node = next) {
+    CHECK(node->value == 98 - n);
+    // Unlinked so a stale pointer to one node can't keep the others alive
+    next = node->next;
+    node->next = NULL;
+    n++;
+  }
+  CHECK(n == 99);
+  my_gc_get_stats(&stats);
+  CHECK(stats.slices >= (size_t) steps);
+}
+
+static void test_incremental(void) {
+  size_t before = live_blocks();
+  check_incremental();
+  global_list = NULL;
+  CHECK(live_blocks() <= before + SLACK);
+}
+
+__attribute__((noinline)) static void push_young_nodes(Node *holder, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    Node *node = my_calloc_gc(sizeof(Node));
+    node->value = i;
+    node->next = holder->next;
+    my_gc_write_barrier((void **) &holder->next, node);
+    make_garbage(100);
+  }
+}
+
+/* Hangs young nodes off a promoted block through the write barrier while
+   garbage keeps the nursery collecting, then checks none of them was freed. */
+__attribute__((noinline)) static void check_generational(void) {
+  struct GCStats stats = {0};
+  Node *holder = my_calloc_gc(sizeof(Node));
+  global_list = holder;
+  make_garbage(10000);
+  push_young_nodes(holder, 100);
+  clear_stack();
+  my_gc_get_stats(&stats);
+  size_t heap_size = stats.heap_size;
+  make_garbage(10000);
+
+  size_t n = 0;
+  for (Node *node = holder->next, *next; node != NULL; node = next) {
+    CHECK(node->value == 99 - n);
+    // Unlinked so a stale pointer to one node can't keep the others alive
+    next = node->next;
+    node->next = NULL;
+    n++;
+  }
+  CHECK(n == 100);
+  my_gc_get_stats(&stats);
+  CHECK(stats.minor_collections > 0);
+  CHECK(stats.promoted_bytes > 0);
+  CHECK(stats.heap_size == heap_size);
+}
+
+static void test_generational(void) {
+  size_t before = live_blocks();
+  my_gc_set_generational(1, 64 << 10, 1);
+  check_generational();
+  my_gc_set_generational(0, 0, 0);
+  global_list = NULL;
+  CHECK(live_blocks() <= before + SLACK);
+}
+
+typedef struct Pair Pair;
+struct Pair {
+  Node *node;
+  // Looks like a pointer, but the layout says it isn't one
+  size_t data;
+};
+
+__attribute__((noinline)) static Pair *make_pairs(size_t n, int layout) {
+  Pair *pairs = my_malloc_typed(n * sizeof(Pair), layout);
+  for (size_t i = 0; i < n; i++) {
+    pairs[i].node = my_calloc_gc(sizeof(Node));
+    pairs[i].data = (size_t) my_calloc_gc(sizeof(Node));
+  }
+  return pairs;
+}
+
+__attribute__((noinline)) static void check_typed(size_t before, int layout) {
+  Pair *pairs = make_pairs(100, layout);
+  CHECK(live_blocks() >= before + 101);
+  CHECK(live_blocks() <= before + 101 + SLACK);
+  pairs[99].node->value = 1;
+
+  // Nothing in a block without pointers is traced
+  void **words = my_malloc_typed(100 * sizeof(void *), GC_NO_POINTERS);
+  for (size_t i = 0; i < 100; i++) {
+    words[i] = my_calloc_gc(sizeof(Node));
+  }
+  CHECK(live_blocks() <= before + 102 + SLACK);
+  words[0] = NULL;
+}
+
+static void test_typed(void) {
+  struct GCLayout pair = {0, 2, 1};
+  int layout = my_gc_register_layout(&pair);
+  CHECK(layout > GC_NO_POINTERS);
+  CHECK(my_gc_register_layout(&pair) == layout);
+  size_t before = live_blocks();
+  check_typed(before, layout);
+  CHECK(live_blocks() <= before + SLACK);
+}
+
 int main(void) {
   set_start_of_stack(__builtin_frame_address(0));
-  // Replace below with your own GC tests
 
   char *a = my_calloc_gc(8);
   char *b = my_calloc_gc(16);
   b = NULL;
-
   my_gc();
-
   // At this point the block "b" should have been freed as garbage as no pointers exist to it anymore
+  a[0] = 1;
+
+  clear_stack();
+  test_unreachable_freed();
+  clear_stack();
+  test_reachable_kept();
+  clear_stack();
+  test_interior_pointer();
+  clear_stack();
+  test_memory_reused();
+
+  // Same again with parallel marking
+  my_gc_set_threads(4);
+  clear_stack();
+  test_unreachable_freed();
+  clear_stack();
+  test_reachable_kept();
+  clear_stack();
+  test_interior_pointer();
+
+  my_gc_set_threads(1);
+  clear_stack();
+  test_incremental();
+  clear_stack();
+  test_generational();
+  clear_stack();
+  test_typed();
+  return b != NULL;
 }
@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+
+# Generates the size-class table of mymalloc (src/size_classes.h) from an
+# allocation size histogram recorded by a build with HISTOGRAM=1:
+#
+#   make clean && make bench HISTOGRAM=1 RELEASE=1
+#   MYMALLOC_HISTOGRAM=sizes.txt ./bench/latency
+#   ./sizeclasses.py sizes.txt -n 32 -o src/size_classes.h
+#
+# The classes are the block sizes (payload plus header and footer, rounded
+# to the alignment) that minimise the internal fragmentation of the recorded
+# allocations, i.e. the bytes a block is rounded up by, summed over all of
+# them. Blocks larger than the largest class aren't rounded.
+#
+# The compact block format (make COMPACT=1) has smaller blocks and its own
+# table:
+#
+#   ./sizeclasses.py sizes.txt -n 32 --compact -o src/size_classes_compact.h
+
+import argparse
+import sys
+from typing import Dict, List, Tuple
+
+ALIGNMENT = 8
+# Header and footer
+METADATA = 16
+# Smallest block: header, free list links and footer
+MIN_BLOCK = 32
+# The same with 4 byte boundary tags and links
+COMPACT_METADATA = 8
+COMPACT_MIN_BLOCK = 16
+# Classes index a 64-bit mask of non-empty free lists, with one list for the
+# blocks above the largest class
+MAX_CLASSES = 63
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("histogram", type=str,
+                        help="histogram file of \"size count\" lines")
+    parser.add_argument("-n", "--classes", type=int, default=32,
+                        help="maximum number of size classes (at most 63)")
+    parser.add_argument("-m", "--max-size", type=int, default=4096,
+                        help="largest block size to give a class")
+    parser.add_argument("-o", "--output", type=str, default="-",
+                        help="header to write, default to stdout")
+    parser.add_argument("--compact", action="store_true",
+                        help="classes for the compact block format")
+    return parser.parse_args()
+
+
+def block_size(size: int) -> int:
+    aligned = (size + METADATA + ALIGNMENT - 1) // ALIGNMENT * ALIGNMENT
+    return max(aligned, MIN_BLOCK)
+
+
+def read_histogram(path: str) -> Tuple[Dict[int, int], int]:
+    """Returns the counts per block size, and the count of allocations too
+    large for the histogram."""
+    counts: Dict[int, int] = {}
+    large = 0
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) != 2:
+                continue
+            if fields[0].startswith(">"):
+                large += int(fields[1])
+                continue
+            size = block_size(int(fields[0]))
+            counts[size] = counts.get(size, 0) + int(fields[1])
+    return counts, large
+
+
+def optimal_classes(sizes: List[int], counts: List[int],
+                    n: int) -> Tuple[List[int], int]:
+    """Returns at most `n` class sizes, among them sizes[0] and sizes[-1],
+    minimising the rounding of every size up to its class, and that
+    rounding."""
+    m = len(sizes)
+    # Prefix sums of counts and of count * size, so the rounding of
+    # sizes[i..j] up to sizes[j] is an O(1) expression
+    pc = [0] * (m + 1)
+    ps = [0] * (m + 1)
+    for i in range(m):
+        pc[i + 1] = pc[i] + counts[i]
+        ps[i + 1] = ps[i] + counts[i] * sizes[i]
+
+    def cost(i: int, j: int) -> int:
+        return (pc[j + 1] - pc[i]) * sizes[j] - (ps[j + 1] - ps[i])
+
+    inf = float("inf")
+    # best[k][j]: least rounding of sizes[0..j] with k classes, the last one
+    # being sizes[j]; the first class is sizes[0], which is MIN_BLOCK
+    best = [[inf] * m for _ in range(n + 1)]
+    prev = [[-1] * m for _ in range(n + 1)]
+    best[1][0] = 0
+    for k in range(2, n + 1):
+        for j in range(1, m):
+            for i in range(k - 2, j):
+                if best[k - 1][i] == inf:
+                    continue
+                c = best[k - 1][i] + cost(i + 1, j)
+                if c < best[k][j]:
+                    best[k][j] = c
+                    prev[k][j] = i
+    k = min(range(1, n + 1), key=lambda k: best[k][m - 1])
+    classes = []
+    j = m - 1
+    while j >= 0:
+        classes.append(sizes[j])
+        j = prev[k][j]
+        k -= 1
+    return classes[::-1], int(best[len(classes)][m - 1]) if m > 1 else 0
+
+
+def render(classes: List[int], source: str, wasted: int,
+           requested: int, compact: bool) -> str:
+    max_size = classes[-1]
+    table = []
+    c = 0
+    for words in range(max_size // ALIGNMENT + 1):
+        while classes[c] < words * ALIGNMENT:
+            c += 1
+        table.append(c)
+
+    def rows(values: List[int], per_row: int) -> str:
+        lines = []
+        for i in range(0, len(values), per_row):
+            lines.append("  " + ", ".join(str(v) for v in values[i:i + per_row]) + ",")
+        return "\n".join(lines)
+
+    share = 100.0 * wasted / requested if requested else 0.0
+    name = "mymalloc with compact headers" if compact else "mymalloc"
+    return f"""#ifndef SIZE_CLASSES_HEADER
+#define SIZE_CLASSES_HEADER
+
+/** Size classes of {name}, generated by sizeclasses.py from {source}.
+ *  Block sizes up to MAX_CLASS_SIZE are rounded up to a class, which wastes
+ *  {share:.1f}% of the recorded block bytes.
+ **/
+
+#define N_SIZE_CLASSES {len(classes)}
+#define MAX_CLASS_SIZE {max_size}
+
+// Block size of each class
+static const size_t kClassSize[N_SIZE_CLASSES] = {{
+{rows(classes, 8)}
+}};
+
+// Class of a block of up to MAX_CLASS_SIZE bytes, indexed by its size in words
+static const unsigned char kSizeClass[MAX_CLASS_SIZE / {ALIGNMENT} + 1] = {{
+{rows(table, 16)}
+}};
+
+#endif
+"""
+
+
+def main():
+    global METADATA, MIN_BLOCK
+    args = parse_args()
+    if args.compact:
+        METADATA, MIN_BLOCK = COMPACT_METADATA, COMPACT_MIN_BLOCK
+    if not 1 <= args.classes <= MAX_CLASSES:
+        sys.exit(f"the number of classes must be between 1 and {MAX_CLASSES}")
+    counts, large = read_histogram(args.histogram)
+    max_size = block_size(args.max_size - METADATA)
+    # The smallest block has a class so that every free block fits a list
+    counts.setdefault(MIN_BLOCK, 0)
+    sizes = sorted(s for s in counts if s <= max_size)
+    if sizes[-1] < max_size:
+        sizes.append(max_size)
+        counts[max_size] = 0
+    classes, wasted = optimal_classes(sizes, [counts[s] for s in sizes],
+                                      args.classes)
+    requested = sum(s * c for s, c in counts.items() if s <= max_size)
+    header = render(classes, args.histogram, wasted, requested, args.compact)
+    if args.output == "-":
+        sys.stdout.write(header)
+    else:
+        with open(args.output, "w") as f:
+            f.write(header)
+    total = sum(counts.values()) + large
+    print(f"{len(classes)} classes up to {max_size} bytes for {total} "
+          f"allocations ({large} larger than the histogram), "
+          f"{100.0 * wasted / max(requested, 1):.1f}% of block bytes wasted",
+          file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -303,6 +303,46 @@ void my_free(void *ptr) {
   coalesce_adjacent_blocks(block);
 }
 
+void my_free_sized(void *ptr, size_t size) {
+  my_free(ptr);
+}
+
+void *my_malloc_flags(size_t size, int flags) {
+  return my_malloc(size);
+}
+
+void *my_calloc(size_t count, size_t size) {
+  size_t bytes;
+  if (__builtin_mul_overflow(count, size, &bytes)) {
+    return NULL;
+  }
+  void *ptr = my_malloc(bytes);
+  if (ptr != NULL) {
+    memset(ptr, 0, bytes);
+  }
+  return ptr;
+}
+
+void *my_realloc(void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return my_malloc(size);
+  }
+  if (size == 0) {
+    my_free(ptr);
+    return NULL;
+  }
+  size_t capacity = block_size(ptr_to_block(ptr)) - kMetadataSize;
+  if (size <= capacity) {
+    return ptr;
+  }
+  void *new_ptr = my_malloc(size);
+  if (new_ptr != NULL) {
+    memcpy(new_ptr, ptr, capacity);
+    my_free(ptr);
+  }
+  return new_ptr;
+}
+
 /** These are helper functions you are required to implement for internal testing
  *  purposes. Depending on the optimisations you implement, you will need to
  *  update these functions yourself.
@@ -66,6 +66,10 @@ void coalesce_adjacent_blocks(Block *free_block);
 int is_valid_block(Block *block);
 void *my_malloc(size_t size);
 void my_free(void *p);
+void my_free_sized(void *p, size_t size);
+void *my_realloc(void *p, size_t size);
+void *my_calloc(size_t count, size_t size);
+void *my_malloc_flags(size_t size, int flags);
 
 /* Helper functions you are required to implement for internal testing. */
 int is_free(Block *block);
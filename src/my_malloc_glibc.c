@@ -0,0 +1,77 @@
+#define _GNU_SOURCE
+#include "mymalloc.h"
+#include <malloc.h>
+
+/** glibc's malloc behind the my_malloc interface (make
+ *  MALLOC=my_malloc_glibc), as the baseline of the benchmark matrix (see
+ *  bench.py --matrix). Only what the benchmarks use is implemented: the
+ *  allocation functions, and block_size through malloc_usable_size, counting
+ *  glibc's one word chunk header as the metadata.
+ **/
+
+// Word alignment
+const size_t kAlignment = sizeof(size_t);
+// Minimum allocation size (1 word)
+const size_t kMinAllocationSize = kAlignment;
+// Size of glibc's chunk header
+const size_t kMetadataSize = sizeof(size_t);
+// Maximum allocation size, as mymalloc's (4 GB)
+const size_t kMaxAllocationSize = (4ull << 30);
+// Memory size that is mmapped (64 MB)
+const size_t kMemorySize = (64ull << 20);
+
+size_t kHeapSize = 0ull;
+
+void *my_malloc(size_t size) {
+  if (size == 0 || size > kMaxAllocationSize) {
+    return NULL;
+  }
+  return malloc(size);
+}
+
+void my_free(void *ptr) {
+  free(ptr);
+}
+
+void my_free_sized(void *ptr, size_t size) {
+  free(ptr);
+}
+
+void *my_malloc_flags(size_t size, int flags) {
+  size_t alignment = flags & MY_MALLOC_PAGE ? 4096 : flags & MY_MALLOC_CACHE_LINE ? 64 : 0;
+  if (alignment == 0) {
+    return my_malloc(size);
+  }
+  if (size == 0 || size > kMaxAllocationSize) {
+    return NULL;
+  }
+  // Padded too, so no other block shares the last line or page
+  return aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+}
+
+void *my_realloc(void *ptr, size_t size) {
+  if (size > kMaxAllocationSize) {
+    return NULL;
+  }
+  if (size == 0) {
+    free(ptr);
+    return NULL;
+  }
+  return realloc(ptr, size);
+}
+
+void *my_calloc(size_t count, size_t size) {
+  return calloc(count, size);
+}
+
+Block *ptr_to_block(void *ptr) {
+  return ADD_BYTES(ptr, -((size_t) kMetadataSize));
+}
+
+size_t block_size(Block *block) {
+  return malloc_usable_size(ADD_BYTES(block, kMetadataSize)) + kMetadataSize;
+}
+
+int is_free(Block *block) {
+  return 0;
+}
@@ -0,0 +1,108 @@
+#include "myarena.h"
+
+// Default size of the blocks an arena takes from my_malloc (64 KB)
+const size_t kArenaBlockSize = (64ull << 10);
+
+inline static size_t round_up(size_t size, size_t alignment) {
+  const size_t mask = alignment - 1;
+  return (size + mask) & ~mask;
+}
+
+static char *block_start(ArenaBlock *block) {
+  return (char *) round_up((size_t) (block + 1), kAlignment);
+}
+
+static void use_block(Arena *arena, ArenaBlock *block) {
+  arena->current = block;
+  arena->top = block_start(block);
+  arena->end = block->end;
+}
+
+/* Gets a block of at least `size` bytes after the current one, reusing the
+   next block if it is large enough. A new block is linked in right after the
+   current one so the blocks after it stay in order for later reuse. */
+static ArenaBlock *next_block(Arena *arena, size_t size) {
+  ArenaBlock *next = arena->current->next;
+  if (next != NULL && (size_t) (next->end - block_start(next)) >= size) {
+    return next;
+  }
+  size_t bytes;
+  if (__builtin_add_overflow(round_up(sizeof(ArenaBlock), kAlignment), size, &bytes)) {
+    return NULL;
+  }
+  if (bytes < arena->block_size) {
+    bytes = arena->block_size;
+  }
+  ArenaBlock *block = my_malloc(bytes);
+  if (block == NULL) {
+    return NULL;
+  }
+  block->end = (char *) block + bytes;
+  block->next = next;
+  arena->current->next = block;
+  return block;
+}
+
+Arena *my_arena_create(size_t block_size) {
+  Arena *arena = my_malloc(sizeof(Arena));
+  if (arena == NULL) {
+    return NULL;
+  }
+  arena->block_size = block_size ? block_size : kArenaBlockSize;
+  // Room for the header and a word at least
+  if (arena->block_size < round_up(sizeof(ArenaBlock), kAlignment) + kAlignment) {
+    arena->block_size = round_up(sizeof(ArenaBlock), kAlignment) + kAlignment;
+  }
+  ArenaBlock *block = my_malloc(arena->block_size);
+  if (block == NULL) {
+    my_free(arena);
+    return NULL;
+  }
+  block->end = (char *) block + arena->block_size;
+  block->next = NULL;
+  arena->first = block;
+  use_block(arena, block);
+  return arena;
+}
+
+void *my_arena_alloc(Arena *arena, size_t size) {
+  if (size > SIZE_MAX - (kAlignment - 1)) {
+    return NULL;
+  }
+  size = round_up(size, kAlignment);
+  if ((size_t) (arena->end - arena->top) < size) {
+    ArenaBlock *block = next_block(arena, size);
+    if (block == NULL) {
+      return NULL;
+    }
+    use_block(arena, block);
+  }
+  void *ptr = arena->top;
+  arena->top += size;
+  return ptr;
+}
+
+struct ArenaMark my_arena_mark(Arena *arena) {
+  struct ArenaMark mark = {arena->current, arena->top};
+  return mark;
+}
+
+void my_arena_rewind(Arena *arena, struct ArenaMark mark) {
+  arena->current = mark.block;
+  arena->top = mark.top;
+  arena->end = mark.block->end;
+}
+
+void my_arena_reset(Arena *arena) {
+  use_block(arena, arena->first);
+}
+
+void my_arena_destroy(Arena *arena) {
+  ArenaBlock *block = arena->first;
+  while (block != NULL) {
+    ArenaBlock *next = block->next;
+    my_free(block);
+    block = next;
+  }
+  my_free(arena);
+}
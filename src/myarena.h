@@ -0,0 +1,58 @@
+#ifndef MYARENA_HEADER
+#define MYARENA_HEADER
+
+#include "mymalloc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Regions for request-scoped allocation: objects are bump-allocated from
+ *  blocks taken from my_malloc, carry no header, and are only released all
+ *  together, by rewinding to a mark or resetting the arena. Blocks are kept
+ *  for reuse until the arena is destroyed.
+ **/
+typedef struct Arena Arena;
+typedef struct ArenaBlock ArenaBlock;
+
+struct ArenaBlock {
+  ArenaBlock *next;
+  // End of the usable space, which starts right after this struct
+  char *end;
+};
+
+struct Arena {
+  ArenaBlock *first;
+  ArenaBlock *current;
+  // Next free byte and end of the current block
+  char *top;
+  char *end;
+  size_t block_size;
+};
+
+/* A position in an arena to rewind to. */
+struct ArenaMark {
+  ArenaBlock *block;
+  char *top;
+};
+
+/* Creates an arena taking blocks of `block_size` bytes (0 for the default,
+   64 KB) from my_malloc, raised to fit a block's header and a word. Returns
+   NULL if my_malloc fails. */
+Arena *my_arena_create(size_t block_size);
+/* Returns `size` bytes aligned to kAlignment, or NULL (also if a block that
+   large can't be asked for). */
+void *my_arena_alloc(Arena *arena, size_t size);
+struct ArenaMark my_arena_mark(Arena *arena);
+/* Releases everything allocated since `mark` was taken. */
+void my_arena_rewind(Arena *arena, struct ArenaMark mark);
+/* Releases everything in the arena in O(1), keeping its blocks. */
+void my_arena_reset(Arena *arena);
+/* Returns the arena and all its blocks to my_free. */
+void my_arena_destroy(Arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,294 @@
+#include "mycache.h"
+#include "mymalloc.h"
+#include "mypages.h"
+#include "mytrace.h"
+#include <pthread.h>
+#include <stdint.h>
+
+__thread MyThreadCache my_thread_cache __attribute__((tls_model("initial-exec")));
+
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+// Its destructor empties the cache of an exiting thread
+static pthread_key_t cache_key;
+
+/** Central free lists: a list that overflows hands a batch of its blocks to
+ *  the central list of its class, and one that runs dry takes a batch from
+ *  there before it falls back to my_malloc, so blocks freed by one thread
+ *  are reused by another without going back through the heap and its lock.
+ *
+ *  A central list is a lock-free stack of batch descriptors, pushed and
+ *  popped with a compare-and-swap on its head. Descriptors live in a static
+ *  array and never hold anything else, so a thread that read a head just
+ *  before another thread popped it reads a stale descriptor, never a block
+ *  in use. The head is an index into the array, tagged with a version bumped
+ *  by every push and pop; the CAS of a thread holding a stale head fails
+ *  even if the same descriptor is back on top (ABA).
+ *
+ *  With no free descriptor, or CENTRAL_MAX_BATCHES batches on a list
+ *  already, blocks go back to the heap with my_free_sized as before.
+ *  MYMALLOC_CENTRAL=0 in the environment turns the central lists off.
+ **/
+#define CENTRAL_DESCRIPTORS 65536
+#define CENTRAL_MAX_BATCHES 256
+
+typedef struct Batch {
+  // Index of the next descriptor on the stack, 0 for none
+  uint32_t next;
+  uint32_t count;
+  // Blocks, linked through their first word
+  void *blocks;
+} Batch;
+
+// Descriptor 0 stands for none
+static Batch batches[CENTRAL_DESCRIPTORS];
+// Descriptors not handed out yet, from 1
+static uint32_t batches_used = 1;
+// Tagged heads: version in the high 32 bits, descriptor index in the low
+static uint64_t central_lists[MY_CACHE_CLASSES];
+static uint32_t central_batches[MY_CACHE_CLASSES];
+static uint64_t free_descriptors = 0;
+static int central_enabled = 1;
+
+static void push_batch(uint64_t *head, uint32_t index) {
+  uint64_t old = __atomic_load_n(head, __ATOMIC_RELAXED);
+  uint64_t new;
+  do {
+    __atomic_store_n(&batches[index].next, (uint32_t) old, __ATOMIC_RELAXED);
+    new = ((old >> 32) + 1) << 32 | index;
+  } while (!__atomic_compare_exchange_n(head, &old, new, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* Returns the index of the descriptor popped, 0 if the stack is empty. */
+static uint32_t pop_batch(uint64_t *head) {
+  uint64_t old = __atomic_load_n(head, __ATOMIC_ACQUIRE);
+  uint64_t new;
+  do {
+    uint32_t index = (uint32_t) old;
+    if (index == 0) {
+      return 0;
+    }
+    // Stale if another thread pops it first, in which case the CAS fails
+    uint32_t next = __atomic_load_n(&batches[index].next, __ATOMIC_RELAXED);
+    new = ((old >> 32) + 1) << 32 | next;
+  } while (!__atomic_compare_exchange_n(head, &old, new, 1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+  return (uint32_t) old;
+}
+
+static uint32_t new_descriptor(void) {
+  uint32_t index = pop_batch(&free_descriptors);
+  if (index == 0 && __atomic_load_n(&batches_used, __ATOMIC_RELAXED) < CENTRAL_DESCRIPTORS) {
+    index = __atomic_fetch_add(&batches_used, 1, __ATOMIC_RELAXED);
+    if (index >= CENTRAL_DESCRIPTORS) {
+      index = 0;
+    }
+  }
+  return index;
+}
+
+/* Hands `count` blocks linked from `blocks` to the central list of a class.
+   Returns 0 if it is full or out of descriptors. */
+static int give_central(int size_class, void *blocks, unsigned count) {
+  if (!central_enabled) {
+    return 0;
+  }
+  uint32_t index = 0;
+  if (__atomic_add_fetch(&central_batches[size_class], 1, __ATOMIC_RELAXED) > CENTRAL_MAX_BATCHES ||
+      (index = new_descriptor()) == 0) {
+    __atomic_sub_fetch(&central_batches[size_class], 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  batches[index].blocks = blocks;
+  batches[index].count = count;
+  push_batch(&central_lists[size_class], index);
+  return 1;
+}
+
+/* Moves a batch from the central list of a class to the thread's list, which
+   is empty, and returns one of its blocks, or NULL if there is none. */
+static void *take_central(int size_class) {
+  uint32_t index = central_enabled ? pop_batch(&central_lists[size_class]) : 0;
+  if (index == 0) {
+    return NULL;
+  }
+  __atomic_sub_fetch(&central_batches[size_class], 1, __ATOMIC_RELAXED);
+  void *first = batches[index].blocks;
+  my_thread_cache.lists[size_class] = *(void **) first;
+  my_thread_cache.counts[size_class] = batches[index].count - 1;
+  push_batch(&free_descriptors, index);
+  return first;
+}
+
+/** Slabs: a span of SLAB_PAGES pages cut into blocks of one class, carved
+ *  off in order and recycled through a free list. Each class keeps a list
+ *  of its slabs with blocks to hand out, under a lock of its own. A slab
+ *  whose blocks have all come back returns to the page heap, unless it is
+ *  the only one its class has left.
+ **/
+#define SLAB_PAGES 16
+
+int my_cache_slabs = 0;
+
+struct SlabClass {
+  pthread_mutex_t lock;
+  Span *partial;
+};
+
+static struct SlabClass slab_classes[MY_CACHE_CLASSES] = {
+    [0 ... MY_CACHE_CLASSES - 1] = {PTHREAD_MUTEX_INITIALIZER, NULL}};
+
+inline static int slab_full(Span *span) {
+  return span->slab.free == NULL && span->slab.carved == span->slab.capacity;
+}
+
+static void push_partial(struct SlabClass *c, Span *span) {
+  span->prev = NULL;
+  span->next = c->partial;
+  if (c->partial != NULL) {
+    c->partial->prev = span;
+  }
+  c->partial = span;
+}
+
+static void remove_partial(struct SlabClass *c, Span *span) {
+  if (span->prev != NULL) {
+    span->prev->next = span->next;
+  } else {
+    c->partial = span->next;
+  }
+  if (span->next != NULL) {
+    span->next->prev = span->prev;
+  }
+}
+
+/* Fills the thread's empty list of a class with `n` slab blocks, and
+   returns one of them. */
+static void *take_slab(int size_class, unsigned n) {
+  struct SlabClass *c = &slab_classes[size_class];
+  size_t size = (size_t) size_class * MY_CACHE_QUANTUM;
+  pthread_mutex_lock(&c->lock);
+  for (unsigned i = 0; i < n; i++) {
+    Span *span = c->partial;
+    if (span == NULL) {
+      span = my_span_alloc(SLAB_PAGES, MY_SPAN_SLAB);
+      span->slab.size_class = size_class;
+      span->slab.capacity = (SLAB_PAGES * MY_PAGE_SIZE) / size;
+      push_partial(c, span);
+    }
+    void *block = span->slab.free;
+    if (block != NULL) {
+      span->slab.free = *(void **) block;
+    } else {
+      block = span->start + span->slab.carved++ * size;
+    }
+    span->slab.used++;
+    if (slab_full(span)) {
+      remove_partial(c, span);
+    }
+    *(void **) block = my_thread_cache.lists[size_class];
+    my_thread_cache.lists[size_class] = block;
+  }
+  pthread_mutex_unlock(&c->lock);
+  void *first = my_thread_cache.lists[size_class];
+  my_thread_cache.lists[size_class] = *(void **) first;
+  my_thread_cache.counts[size_class] = n - 1;
+  return first;
+}
+
+void my_slab_free(Span *span, void *ptr) {
+  struct SlabClass *c = &slab_classes[span->slab.size_class];
+  size_t size = (size_t) span->slab.size_class * MY_CACHE_QUANTUM;
+  if ((size_t) ((char *) ptr - span->start) % size != 0) {
+    return;
+  }
+  pthread_mutex_lock(&c->lock);
+  if (slab_full(span)) {
+    push_partial(c, span);
+  }
+  *(void **) ptr = span->slab.free;
+  span->slab.free = ptr;
+  int empty = --span->slab.used == 0 && (c->partial != span || span->next != NULL);
+  if (empty) {
+    remove_partial(c, span);
+  }
+  pthread_mutex_unlock(&c->lock);
+  if (empty) {
+    my_span_free(span);
+  }
+}
+
+/* Blocks taken per refill: about 4 KB worth, between 4 and 64. */
+static unsigned batch_size(int size_class) {
+  unsigned n = 4096 / (size_class * MY_CACHE_QUANTUM);
+  return n < 4 ? 4 : n > 64 ? 64 : n;
+}
+
+/* Gives all but `keep` blocks of a list back, to the central list if it
+   takes them and to the heap if not. */
+static void drain(int size_class, unsigned keep) {
+  unsigned count = my_thread_cache.counts[size_class];
+  if (count <= keep) {
+    return;
+  }
+  // Cut the blocks to give off the front of the list
+  void *blocks = my_thread_cache.lists[size_class];
+  void *last = blocks;
+  for (unsigned i = 1; i < count - keep; i++) {
+    last = *(void **) last;
+  }
+  my_thread_cache.lists[size_class] = *(void **) last;
+  my_thread_cache.counts[size_class] = keep;
+  *(void **) last = NULL;
+  if (give_central(size_class, blocks, count - keep)) {
+    return;
+  }
+  size_t size = (size_t) size_class * MY_CACHE_QUANTUM;
+  while (blocks != NULL) {
+    void *next = *(void **) blocks;
+    my_free_sized(blocks, size);
+    blocks = next;
+  }
+}
+
+static void flush_thread(void *arg) {
+  for (int c = 1; c < MY_CACHE_CLASSES; c++) {
+    drain(c, 0);
+  }
+}
+
+static void create_key(void) {
+  pthread_key_create(&cache_key, flush_thread);
+  const char *env = getenv("MYMALLOC_CENTRAL");
+  central_enabled = env == NULL || atoi(env) != 0;
+}
+
+void *my_cache_refill(int size_class) {
+  pthread_once(&cache_once, create_key);
+  // Any non-NULL value, for the destructor to run
+  pthread_setspecific(cache_key, &my_thread_cache);
+  void *first = take_central(size_class);
+  if (first != NULL) {
+    return first;
+  }
+  size_t size = (size_t) size_class * MY_CACHE_QUANTUM;
+  unsigned n = batch_size(size_class);
+  MY_TRACE(MY_TRACE_CACHE_REFILL, NULL, size, n);
+  if (my_cache_slabs) {
+    return take_slab(size_class, n);
+  }
+  first = my_malloc(size);
+  for (unsigned i = 1; first != NULL && i < n; i++) {
+    void *block = my_malloc(size);
+    if (block == NULL) {
+      break;
+    }
+    *(void **) block = my_thread_cache.lists[size_class];
+    my_thread_cache.lists[size_class] = block;
+    my_thread_cache.counts[size_class]++;
+  }
+  return first;
+}
+
+void my_cache_flush(int size_class) {
+  pthread_once(&cache_once, create_key);
+  drain(size_class, MY_CACHE_LIMIT / 2);
+}
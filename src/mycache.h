@@ -0,0 +1,58 @@
+#ifndef MYCACHE_HEADER
+#define MYCACHE_HEADER
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Thread cache behind the inline fast path of mymalloc.h: per thread, one
+ *  free list per MY_CACHE_QUANTUM bytes of payload up to MY_CACHE_MAX_SIZE,
+ *  linked through the first word of the blocks. The blocks stay allocated
+ *  as far as the allocator knows; a list refills with a batch when it runs
+ *  dry and gives half of its blocks back when it grows past MY_CACHE_LIMIT,
+ *  and all of them when the thread exits. Batches go through a lock-free
+ *  central list per class shared by the threads (see mycache.c), and come
+ *  from my_malloc and go back with my_free when it is empty or full. So the
+ *  heap profiler and the event trace see the blocks when they enter and
+ *  leave the caches, not each reuse.
+ *
+ *  With mymalloc, new blocks come from slabs instead: spans of the page
+ *  heap cut into blocks of one class, with no header. The profiler doesn't
+ *  see those, and the trace only sees the refills.
+ **/
+
+#define MY_CACHE_QUANTUM 16
+#define MY_CACHE_MAX_SIZE 256
+#define MY_CACHE_CLASSES (MY_CACHE_MAX_SIZE / MY_CACHE_QUANTUM + 1)
+// Blocks a list holds before it flushes half of them
+#define MY_CACHE_LIMIT 128
+
+typedef struct MyThreadCache {
+  void *lists[MY_CACHE_CLASSES];
+  unsigned counts[MY_CACHE_CLASSES];
+} MyThreadCache;
+
+extern __thread MyThreadCache my_thread_cache __attribute__((tls_model("initial-exec")));
+
+/* Class of a payload of `size` bytes, 1 to MY_CACHE_MAX_SIZE. */
+#define MY_CACHE_CLASS(size) (((size) + MY_CACHE_QUANTUM - 1) / MY_CACHE_QUANTUM)
+
+/* Slow paths: refills the empty list of a class and returns one of its
+   blocks (NULL if my_malloc fails), and gives back half of a full list. */
+void *my_cache_refill(int size_class);
+void my_cache_flush(int size_class);
+
+/* Set by an allocator that frees slab blocks with my_slab_free, for lists
+   to refill from slabs rather than with my_malloc. */
+extern int my_cache_slabs;
+struct Span;
+/* Frees a block of a slab span (see mypages.h). */
+void my_slab_free(struct Span *span, void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
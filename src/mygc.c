@@ -1,4 +1,63 @@
+#define _GNU_SOURCE
 #include "mygc.h"
+#include "mytrace.h"
+#include <link.h>
+#include <pthread.h>
+#include <sched.h>
+#include <setjmp.h>
+#include <time.h>
+
+#ifdef COMPACT_HEADERS
+#error "mygc keeps pointers in its free lists, build it without COMPACT=1"
+#endif
+
+/** A conservative mark-sweep collector on top of a segregated free list
+ *  allocator.
+ *
+ *  Chunks are mapped at kMemorySize-aligned addresses and registered in a
+ *  two level radix map, so deciding whether a word points into the heap is a
+ *  couple of loads. Every chunk keeps its bitmaps out-of-band at the front of
+ *  the mapping:
+ *    - start bits: one bit per granule, set where a block (free or allocated)
+ *      begins. A candidate pointer is resolved to its block by searching
+ *      backwards for the closest start bit, which also handles interior
+ *      pointers. A summary bitmap (one bit per non-empty start word) bounds
+ *      that search.
+ *    - mark bits: one bit per granule, set on the granule of a reachable block.
+ *  The sweep only looks at the mark bits and the headers of surviving blocks:
+ *  everything between two survivors becomes a single free block.
+ *
+ *  In incremental mode a collection cycle is split into slices of bounded
+ *  work (and optionally time), run from my_malloc or my_gc_step:
+ *    IDLE -> MARK: clear the mark bits, push the roots.
+ *    MARK: trace from the grey entries. Blocks allocated meanwhile are marked
+ *      at once (allocate-black) and logged. Once no grey entries are left,
+ *      a final remark rescans the stack, registers and data segment, which
+ *      have no write barrier, and the logged blocks, whose contents were
+ *      written after they were marked, and traces to completion.
+ *    SWEEP: chunks are swept lazily. Free lists start empty and only receive
+ *      the free runs of the parts already swept.
+ *  Pointers stored into blocks that existed before the cycle started must go
+ *  through my_gc_write_barrier while a cycle is active.
+ *
+ *  In generational mode small blocks are allocated from a nursery, a chunk
+ *  of its own that is not on the free lists but walked in address order.
+ *  Blocks can't move (any stack word may point at them), so a generation is
+ *  a property of the block: its age, the number of collections it survived,
+ *  sits in two header bits, and a block reaching `promote_age` becomes old in
+ *  place. Mark bits of old blocks stay set between collections ("sticky"), so
+ *  a minor collection only traces young blocks and sweeps only the nursery.
+ *  Old blocks pointing at young ones are found through a card table of one
+ *  byte per 512 bytes, dirtied by my_gc_write_barrier. A minor collection
+ *  scans the roots and the dirty cards, and cleans the cards that no longer
+ *  point into the young generation. A nursery clogged by old blocks is
+ *  retired into the old generation and replaced by a fresh one.
+ *
+ *  Blocks from my_malloc_typed carry the id of a registered layout in the top
+ *  bits of their header. The mark skips blocks without pointers and only
+ *  reads the pointer slots of the others; untyped blocks are scanned word by
+ *  word. Layouts describe a single element that repeats over the payload.
+ **/
 
 static void *start_of_stack = NULL;
 
@@ -13,25 +72,1529 @@ const size_t kMaxAllocationSize = (128ull << 20) - kMetadataSize;
 // Memory size that is mmapped (64 MB)
 const size_t kMemorySize = (64ull << 20);
 
+// Smallest block that can hold the free list links
+static const size_t kMinBlockSize = sizeof(Block) + sizeof(Linker);
+
+// Age of a block in header bits 1-2, sizes are multiples of a granule
+#define AGE_SHIFT 1
+#define AGE_MASK ((size_t) 6)
+#define AGE_OLD 3
+// Layout id of a block in the top 16 bits of the header
+#define LAYOUT_SHIFT 48
+#define LAYOUT_MASK (~(size_t) 0 << LAYOUT_SHIFT)
+#define HEADER_BITS (ALLOCATED_MASK | AGE_MASK | LAYOUT_MASK)
+
+#define MAX_LAYOUTS 1024
+
+// One bit of every side bitmap covers one granule (one word)
+#define GRANULE_SHIFT 3
+// One card covers the granules of one bitmap word (512 bytes)
+#define CARD_SHIFT (GRANULE_SHIFT + 6)
+// log2(kMemorySize), chunks are aligned to this
+#define CHUNK_SHIFT 26
+// Radix map over the 48 bit address space, indexed by chunk number
+#define MAP_LEAF_BITS 11
+#define MAP_ROOT_BITS (48 - CHUNK_SHIFT - MAP_LEAF_BITS)
+
+// Size classes: exact classes below 512 bytes, power of two classes above
+#define N_BINS 96
+#define N_EXACT_BINS 64
+
+typedef struct GCChunk GCChunk;
+
+struct GCChunk {
+  GCChunk *next;
+  // Block space of the chunk, [start, end)
+  char *start;
+  char *end;
+  size_t n_granules;
+  size_t map_size;
+  uint64_t *start_bits;
+  uint64_t *summary_bits;
+  uint64_t *mark_bits;
+  // One byte per card, non-zero if it may hold a pointer to a young block
+  uint8_t *cards;
+  // Cleared when a sweep starts, set once the sweep has passed the chunk
+  int swept;
+};
+
+static GCChunk **chunk_map[1 << MAP_ROOT_BITS];
+static GCChunk *chunk_list = NULL;
+// Lowest and highest block addresses, used to reject most words quickly
+static char *heap_lo = (char *) UINTPTR_MAX;
+static char *heap_hi = NULL;
+
+static Linker bins[N_BINS];
+static uint64_t nonempty_bins[(N_BINS + 63) / 64];
+static int is_initialized = 0;
+
+// Mark threads, each with its own deque of grey entries
+#define MAX_MARK_THREADS 64
+#define DEQUE_SIZE (1 << 14)
+// Bytes of a large object scanned per mark entry
+#define SCAN_SLICE 4096
+
+typedef struct MarkWorker MarkWorker;
+
+struct MarkWorker {
+  long top;
+  long bottom;
+  int id;
+  void **deque;
+} __attribute__((aligned(64)));
+
+static MarkWorker workers[MAX_MARK_THREADS];
+static int mark_threads = 0;
+static int idle_workers = 0;
+
+// Shared overflow stack for entries that don't fit in a deque
+static void **mark_stack = NULL;
+static size_t mark_top = 0;
+static size_t mark_cap = 0;
+static pthread_mutex_t overflow_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Pool of mark threads 1..pool_size, parked between collections
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static unsigned long pool_epoch = 0;
+static int pool_size = 0;
+static int pool_finished = 0;
+
+// Root ranges of the current collection
+#define MAX_ROOTS 32
+
+struct RootRange {
+  char *lo;
+  char *hi;
+};
+
+static struct RootRange roots[MAX_ROOTS];
+static int n_roots = 0;
+
+// Bytes currently handed out by my_malloc, and since the last collection
+static size_t allocated_bytes = 0;
+static size_t bytes_since_gc = 0;
+
+static struct GCStats gc_stats;
+
+enum GCPhase { GC_IDLE, GC_MARK, GC_SWEEP };
+
+static enum GCPhase gc_phase = GC_IDLE;
+static int incremental = 0;
+// Work per slice in bytes scanned, and time per slice (0: no limit)
+static size_t slice_work = 256 << 10;
+static uint64_t slice_time_ns = 0;
+// Bytes allocated since the last slice, a slice runs every kSliceAllocBytes
+static size_t alloc_credit = 0;
+static const size_t kSliceAllocBytes = 64 << 10;
+
+// Blocks allocated during the mark phase, rescanned by the final remark
+static Block **alloc_log = NULL;
+static size_t alloc_log_len = 0;
+static size_t alloc_log_cap = 0;
+
+// Sweep position: chunk, next mark word and start of the pending free run
+static GCChunk *sweep_cursor = NULL;
+static size_t sweep_word = 0;
+static size_t sweep_run = 0;
+// Bytes allocated when the sweep started, less the ones freed explicitly
+// in the unswept part since
+static size_t sweep_garbage = 0;
+
+static int generational = 0;
+static size_t nursery_size = 4 << 20;
+static int promote_age = 2;
+// Largest block allocated in the nursery, larger ones are old from the start
+static const size_t kMaxNurseryBlock = 4096;
+static GCChunk *nursery = NULL;
+// Where the walk for a free nursery block continues
+static Block *nursery_cursor = NULL;
+// Bytes allocated in the nursery, and the ones found live by the sweep
+static size_t nursery_bytes = 0;
+static size_t nursery_live = 0;
+
+// Registered layouts, the first two are GC_UNTYPED and GC_NO_POINTERS
+static struct GCLayout layouts[MAX_LAYOUTS] = {{0, 0, 0}, {GC_LAYOUT_NO_POINTERS, 0, 0}};
+static int n_layouts = 2;
+
+inline static size_t round_up(size_t size, size_t alignment) {
+  const size_t mask = alignment - 1;
+  return (size + mask) & ~mask;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/* ============================== Side bitmaps =============================== */
+
+inline static size_t granule_of(GCChunk *c, void *p) {
+  return (size_t) ((char *) p - c->start) >> GRANULE_SHIFT;
+}
+
+inline static Block *granule_block(GCChunk *c, size_t g) {
+  return (Block *) (c->start + (g << GRANULE_SHIFT));
+}
+
+inline static size_t bitmap_words(size_t n_granules) {
+  return (n_granules + 63) >> 6;
+}
+
+static void set_start(GCChunk *c, size_t g) {
+  size_t w = g >> 6;
+  c->start_bits[w] |= 1ull << (g & 63);
+  c->summary_bits[w >> 6] |= 1ull << (w & 63);
+}
+
+static void clear_start(GCChunk *c, size_t g) {
+  size_t w = g >> 6;
+  c->start_bits[w] &= ~(1ull << (g & 63));
+  if (c->start_bits[w] == 0) {
+    c->summary_bits[w >> 6] &= ~(1ull << (w & 63));
+  }
+}
+
+/* Clears the start bits of granules [from, to). */
+static void clear_start_range(GCChunk *c, size_t from, size_t to) {
+  if (from >= to) {
+    return;
+  }
+  size_t first = from >> 6, last = (to - 1) >> 6;
+  uint64_t head = ~0ull << (from & 63);
+  uint64_t tail = ~0ull >> (63 - ((to - 1) & 63));
+  if (first == last) {
+    c->start_bits[first] &= ~(head & tail);
+  } else {
+    c->start_bits[first] &= ~head;
+    memset(&c->start_bits[first + 1], 0, (last - first - 1) * sizeof(uint64_t));
+    c->start_bits[last] &= ~tail;
+  }
+  for (size_t w = first; w <= last; w++) {
+    if (c->start_bits[w] == 0) {
+      c->summary_bits[w >> 6] &= ~(1ull << (w & 63));
+    }
+  }
+}
+
+/* Returns the closest granule at or below g where a block starts, or SIZE_MAX
+   if there is none. */
+static size_t find_start(GCChunk *c, size_t g) {
+  size_t w = g >> 6;
+  uint64_t bits = c->start_bits[w] & (~0ull >> (63 - (g & 63)));
+  if (bits) {
+    return (w << 6) + 63 - __builtin_clzll(bits);
+  }
+  size_t s = w >> 6;
+  uint64_t summary = c->summary_bits[s] & ((1ull << (w & 63)) - 1);
+  while (summary == 0) {
+    if (s == 0) {
+      return SIZE_MAX;
+    }
+    summary = c->summary_bits[--s];
+  }
+  w = (s << 6) + 63 - __builtin_clzll(summary);
+  return (w << 6) + 63 - __builtin_clzll(c->start_bits[w]);
+}
+
+inline static void clear_mark(GCChunk *c, size_t g) {
+  c->mark_bits[g >> 6] &= ~(1ull << (g & 63));
+}
+
+inline static int is_start(GCChunk *c, size_t g) {
+  return (c->start_bits[g >> 6] >> (g & 63)) & 1;
+}
+
+/* Sets the cards covering [lo, hi) of chunk c. */
+static void dirty_cards(GCChunk *c, void *lo, void *hi) {
+  size_t first = (size_t) ((char *) lo - c->start) >> CARD_SHIFT;
+  size_t last = (size_t) ((char *) hi - 1 - c->start) >> CARD_SHIFT;
+  memset(&c->cards[first], 1, last - first + 1);
+}
+
+/* Sets the mark bit of granule g and returns its previous value. Mark words
+   are shared between mark threads, so the update is atomic. */
+inline static int test_and_set_mark(GCChunk *c, size_t g) {
+  uint64_t bit = 1ull << (g & 63);
+  uint64_t *word = &c->mark_bits[g >> 6];
+  if (__atomic_load_n(word, __ATOMIC_RELAXED) & bit) {
+    return 1;
+  }
+  return (__atomic_fetch_or(word, bit, __ATOMIC_RELAXED) & bit) != 0;
+}
+
+/* ================================ Chunk map ================================ */
+
+static GCChunk *chunk_of(void *p) {
+  uintptr_t addr = (uintptr_t) p;
+  if (addr >> 48) {
+    return NULL;
+  }
+  GCChunk **leaf = chunk_map[addr >> (CHUNK_SHIFT + MAP_LEAF_BITS)];
+  if (leaf == NULL) {
+    return NULL;
+  }
+  GCChunk *c = leaf[(addr >> CHUNK_SHIFT) & ((1 << MAP_LEAF_BITS) - 1)];
+  if (c == NULL || (char *) p < c->start || (char *) p >= c->end) {
+    return NULL;
+  }
+  return c;
+}
+
+static void register_chunk(GCChunk *c) {
+  for (size_t off = 0; off < c->map_size; off += kMemorySize) {
+    uintptr_t addr = (uintptr_t) c + off;
+    GCChunk ***leaf = &chunk_map[addr >> (CHUNK_SHIFT + MAP_LEAF_BITS)];
+    if (*leaf == NULL) {
+      *leaf = mmap(NULL, sizeof(GCChunk *) << MAP_LEAF_BITS, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (*leaf == MAP_FAILED) {
+        fprintf(stderr, "mmap failed with error: %s\n", strerror(errno));
+        exit(1);
+      }
+    }
+    (*leaf)[(addr >> CHUNK_SHIFT) & ((1 << MAP_LEAF_BITS) - 1)] = c;
+  }
+}
+
+/* Resolves a candidate pointer to the allocated block containing it. Pointers
+   to headers and to free blocks don't count. */
+static Block *find_block(void *p, GCChunk **chunk) {
+  if ((char *) p < heap_lo || (char *) p >= heap_hi) {
+    return NULL;
+  }
+  GCChunk *c = chunk_of(p);
+  if (c == NULL) {
+    return NULL;
+  }
+  size_t g = find_start(c, granule_of(c, p));
+  if (g == SIZE_MAX) {
+    return NULL;
+  }
+  Block *block = granule_block(c, g);
+  if (is_free(block) || (char *) p < (char *) block + kMetadataSize) {
+    return NULL;
+  }
+  *chunk = c;
+  return block;
+}
+
+/* ================================ Free lists =============================== */
+
+static size_t bin_index(size_t size) {
+  if (size < (N_EXACT_BINS << GRANULE_SHIFT)) {
+    return size >> GRANULE_SHIFT;
+  }
+  size_t bin = N_EXACT_BINS - 9 + (63 - __builtin_clzll(size));
+  return bin < N_BINS ? bin : N_BINS - 1;
+}
+
+static void reset_bins(void) {
+  for (int i = 0; i < N_BINS; i++) {
+    bins[i].next = &bins[i];
+    bins[i].prev = &bins[i];
+  }
+  memset(nonempty_bins, 0, sizeof(nonempty_bins));
+}
+
+/* Free blocks of the nursery are found by walking it, not through the bins. */
+inline static int in_nursery(void *p) {
+  return nursery != NULL && (char *) p >= nursery->start && (char *) p < nursery->end;
+}
+
+static void insert_free_block(Block *block) {
+  if (in_nursery(block)) {
+    return;
+  }
+  size_t i = bin_index(block_size(block));
+  Linker *link = get_linker(block);
+  link->prev = &bins[i];
+  link->next = bins[i].next;
+  bins[i].next->prev = link;
+  bins[i].next = link;
+  nonempty_bins[i >> 6] |= 1ull << (i & 63);
+}
+
+static void remove_free_block(Block *block) {
+  if (in_nursery(block)) {
+    return;
+  }
+  Linker *link = get_linker(block);
+  link->prev->next = link->next;
+  link->next->prev = link->prev;
+  size_t i = bin_index(block_size(block));
+  if (bins[i].next == &bins[i]) {
+    nonempty_bins[i >> 6] &= ~(1ull << (i & 63));
+  }
+}
+
+/* Returns a free block of at least `size` bytes, removed from its bin. */
+static Block *take_free_block(size_t size) {
+  size_t i = bin_index(size);
+  if (i >= N_EXACT_BINS) {
+    // Power of two bins mix sizes, so the requested bin needs a first-fit scan
+    for (Linker *l = bins[i].next; l != &bins[i]; l = l->next) {
+      Block *block = ptr_to_block(l);
+      if (block_size(block) >= size) {
+        remove_free_block(block);
+        return block;
+      }
+    }
+  }
+  // Any block of a later non-empty bin is large enough
+  for (size_t w = i >> 6; w < sizeof(nonempty_bins) / sizeof(uint64_t); w++) {
+    uint64_t bits = nonempty_bins[w];
+    if (w == (i >> 6)) {
+      bits &= i >= N_EXACT_BINS ? (~0ull << (i & 63)) << 1 : ~0ull << (i & 63);
+    }
+    if (bits) {
+      size_t j = (w << 6) + __builtin_ctzll(bits);
+      Block *block = ptr_to_block(bins[j].next);
+      remove_free_block(block);
+      return block;
+    }
+  }
+  return NULL;
+}
+
+/* =========================== Chunks and blocks ============================= */
+
+static size_t chunk_metadata_size(int n) {
+  size_t words = bitmap_words((n * kMemorySize) >> GRANULE_SHIFT);
+  size_t summary_words = (words + 63) >> 6;
+  return round_up(sizeof(GCChunk) + (2 * words + summary_words) * sizeof(uint64_t) + words, kAlignment);
+}
+
+int get_chunk_size(size_t alloc_size) {
+  int n = 1;
+  while (n * kMemorySize - chunk_metadata_size(n) < alloc_size) {
+    n++;
+  }
+  return n;
+}
+
+static GCChunk *map_chunk(int n) {
+  size_t map_size = n * kMemorySize;
+  // Over-allocate so the chunk can be aligned to kMemorySize
+  char *raw = mmap(NULL, map_size + kMemorySize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED) {
+    fprintf(stderr, "mmap failed with error: %s\n", strerror(errno));
+    exit(1);
+  }
+  char *base = (char *) round_up((size_t) raw, kMemorySize);
+  if (base > raw) {
+    munmap(raw, base - raw);
+  }
+  if (base + map_size < raw + map_size + kMemorySize) {
+    munmap(base + map_size, raw + kMemorySize - base);
+  }
+
+  size_t words = bitmap_words(map_size >> GRANULE_SHIFT);
+  GCChunk *c = (GCChunk *) base;
+  c->map_size = map_size;
+  c->start_bits = (uint64_t *) (c + 1);
+  c->summary_bits = c->start_bits + words;
+  c->mark_bits = c->summary_bits + ((words + 63) >> 6);
+  c->cards = (uint8_t *) (c->mark_bits + words);
+  c->start = base + chunk_metadata_size(n);
+  c->end = base + map_size;
+  c->n_granules = (size_t) (c->end - c->start) >> GRANULE_SHIFT;
+  c->swept = 1;
+
+  Block *block = (Block *) c->start;
+  block->size = 0;
+  set_block_size(block, c->end - c->start);
+  set_start(c, 0);
+  insert_free_block(block);
+
+  register_chunk(c);
+  c->next = chunk_list;
+  chunk_list = c;
+  if (c->start < heap_lo) {
+    heap_lo = c->start;
+  }
+  if (c->end > heap_hi) {
+    heap_hi = c->end;
+  }
+  gc_stats.heap_size += c->end - c->start;
+  MY_TRACE(MY_TRACE_CHUNK_MAP, c, map_size, 0);
+  return c;
+}
+
+/* Marks a free block as allocated, returning the unused tail of it to the
+   free lists when it is large enough to be a block of its own. */
+static void allocate_block(Block *block, size_t size) {
+  size_t remain_size = block_size(block) - size;
+  if (remain_size >= kMinBlockSize) {
+    GCChunk *c = chunk_of(block);
+    Block *rest = ADD_BYTES(block, size);
+    rest->size = 0;
+    set_block_size(rest, remain_size);
+    set_start(c, granule_of(c, rest));
+    insert_free_block(rest);
+    set_block_size(block, size);
+  }
+  set_allocated(block, 1);
+}
+
+/* Returns whether the sweep has yet to reach granule g. Free blocks there
+   are stale and not on the free lists. */
+static int is_unswept(GCChunk *c, size_t g) {
+  if (gc_phase != GC_SWEEP || c->swept) {
+    return 0;
+  }
+  return c != sweep_cursor || g >= sweep_run;
+}
+
+/* Frees a block and merges it with free neighbours. The previous block is
+   found through the start bitmap, so blocks don't need footers. */
+static void release_block(GCChunk *c, Block *block) {
+  size_t size = block_size(block);
+  Block *next = ADD_BYTES(block, size);
+  if ((char *) next < c->end && is_free(next) && !is_unswept(c, granule_of(c, next))) {
+    remove_free_block(next);
+    clear_start(c, granule_of(c, next));
+    size += block_size(next);
+  }
+  size_t g = granule_of(c, block);
+  if (g > 0) {
+    Block *prev = granule_block(c, find_start(c, g - 1));
+    if (is_free(prev)) {
+      remove_free_block(prev);
+      clear_start(c, g);
+      size += block_size(prev);
+      block = prev;
+    }
+  }
+  block->size = 0;
+  set_block_size(block, size);
+  insert_free_block(block);
+}
+
 // Call this function in your test code (at the start of main)
 void set_start_of_stack(void *start_addr) {
   start_of_stack = start_addr;
 }
 
-void *my_malloc(size_t size) {
+/* ================================= Marking ================================= */
+
+/** Marking runs on `mark_threads` workers: the collecting thread is worker 0,
+ *  the others come from a lazily started pool. Each worker owns a Chase-Lev
+ *  deque of grey entries; it pushes and pops at the bottom while idle workers
+ *  steal from the top. An entry is either a Block* (scan the whole payload) or
+ *  an address inside a payload with the low bit set (scan from there to the
+ *  end of the block), so large objects are scanned SCAN_SLICE bytes at a time
+ *  and their remainder can be stolen. Entries that don't fit in a deque go to
+ *  a shared, locked overflow stack.
+ **/
+
+static void push_overflow(void *entry) {
+  pthread_mutex_lock(&overflow_lock);
+  if (mark_top == mark_cap) {
+    size_t new_cap = mark_cap ? 2 * mark_cap : 4096;
+    void **stack = mmap(NULL, new_cap * sizeof(void *), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (stack == MAP_FAILED) {
+      fprintf(stderr, "mmap failed with error: %s\n", strerror(errno));
+      exit(1);
+    }
+    if (mark_stack != NULL) {
+      memcpy(stack, mark_stack, mark_top * sizeof(void *));
+      munmap(mark_stack, mark_cap * sizeof(void *));
+    }
+    mark_stack = stack;
+    mark_cap = new_cap;
+  }
+  mark_stack[mark_top] = entry;
+  __atomic_store_n(&mark_top, mark_top + 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&overflow_lock);
+}
+
+static void *pop_overflow(void) {
+  void *entry = NULL;
+  if (__atomic_load_n(&mark_top, __ATOMIC_ACQUIRE) == 0) {
+    return NULL;
+  }
+  pthread_mutex_lock(&overflow_lock);
+  if (mark_top > 0) {
+    entry = mark_stack[mark_top - 1];
+    __atomic_store_n(&mark_top, mark_top - 1, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&overflow_lock);
+  return entry;
+}
+
+static void push_mark(MarkWorker *w, void *entry) {
+  long b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED);
+  long t = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+  if (b - t >= DEQUE_SIZE) {
+    push_overflow(entry);
+    return;
+  }
+  __atomic_store_n(&w->deque[b & (DEQUE_SIZE - 1)], entry, __ATOMIC_RELAXED);
+  __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELEASE);
+}
+
+static void *pop_mark(MarkWorker *w) {
+  long b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n(&w->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long t = __atomic_load_n(&w->top, __ATOMIC_RELAXED);
+  if (t > b) {
+    __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  void *entry = __atomic_load_n(&w->deque[b & (DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+  if (t == b) {
+    // Last entry, race against thieves for it
+    if (!__atomic_compare_exchange_n(&w->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      entry = NULL;
+    }
+    __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+  }
+  return entry;
+}
+
+/* Takes the oldest entry of another worker's deque. Returns NULL when the
+   deque is empty or another thief got there first. */
+static void *steal_mark(MarkWorker *victim) {
+  long t = __atomic_load_n(&victim->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long b = __atomic_load_n(&victim->bottom, __ATOMIC_ACQUIRE);
+  if (t >= b) {
+    return NULL;
+  }
+  void *entry = __atomic_load_n(&victim->deque[t & (DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+  if (!__atomic_compare_exchange_n(&victim->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    return NULL;
+  }
+  return entry;
+}
+
+static int has_mark_work(void) {
+  if (__atomic_load_n(&mark_top, __ATOMIC_ACQUIRE) > 0) {
+    return 1;
+  }
+  for (int i = 0; i < mark_threads; i++) {
+    if (__atomic_load_n(&workers[i].bottom, __ATOMIC_ACQUIRE) > __atomic_load_n(&workers[i].top, __ATOMIC_ACQUIRE)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+inline static int layout_of(Block *block) {
+  return block->size >> LAYOUT_SHIFT;
+}
+
+/* Marks a block and queues it for scanning, unless it holds no pointers. */
+inline static void shade(MarkWorker *w, GCChunk *c, Block *block) {
+  if (!test_and_set_mark(c, granule_of(c, block)) && layout_of(block) != GC_NO_POINTERS) {
+    push_mark(w, block);
+  }
+}
+
+/* Conservatively treats every aligned word in [lo, hi) as a pointer. Roots are
+   read straight off the stack and the data segment, so this must not be
+   instrumented by the address sanitizer. */
+__attribute__((no_sanitize_address))
+static void scan_range(MarkWorker *w, void *lo, void *hi) {
+  void **p = (void **) round_up((size_t) lo, kAlignment);
+  for (; (char *) (p + 1) <= (char *) hi; p++) {
+    GCChunk *c = NULL;
+    Block *block = find_block(*p, &c);
+    if (block != NULL) {
+      shade(w, c, block);
+    }
+  }
+}
+
+/* Scans the pointer slots in [p, end) of a typed block's payload, reading
+   nothing else. */
+static void scan_typed(MarkWorker *w, const struct GCLayout *layout, void **payload, void **p, void **end) {
+  size_t k = (size_t) (p - payload) % layout->words;
+  while (p < end) {
+    // Slots k and up of the element p is in
+    uint64_t bits = layout->pointer_bits >> k;
+    while (bits) {
+      void **slot = p + __builtin_ctzll(bits);
+      if (slot >= end) {
+        break;
+      }
+      GCChunk *c = NULL;
+      Block *block = find_block(*slot, &c);
+      if (block != NULL) {
+        shade(w, c, block);
+      }
+      bits &= bits - 1;
+    }
+    p += layout->words - k;
+    k = 0;
+  }
+}
+
+/* Returns whether `slot` in the payload of `block` may hold a pointer. */
+static int is_pointer_slot(Block *block, void **slot) {
+  int id = layout_of(block);
+  if (id == GC_UNTYPED) {
+    return 1;
+  }
+  const struct GCLayout *layout = &layouts[id];
+  if (layout->flags & GC_LAYOUT_NO_POINTERS) {
+    return 0;
+  }
+  size_t k = (size_t) (slot - (void **) ADD_BYTES(block, kMetadataSize)) % layout->words;
+  return (layout->pointer_bits >> k) & 1;
+}
+
+/* Scans one grey entry and returns the number of bytes scanned. The block of
+   an entry may have been freed by my_free since it was pushed; those entries
+   are dropped. */
+static size_t scan_entry(MarkWorker *w, void *entry) {
+  char *p, *end;
+  GCChunk *c = chunk_of((char *) entry + kMetadataSize);
+  Block *block;
+  if ((uintptr_t) entry & 1) {
+    p = (char *) entry - 1;
+    block = granule_block(c, find_start(c, granule_of(c, p)));
+  } else {
+    block = entry;
+    if (!is_start(c, granule_of(c, block))) {
+      return 0;
+    }
+    p = ADD_BYTES(block, kMetadataSize);
+  }
+  if (is_free(block)) {
+    return 0;
+  }
+  const struct GCLayout *layout = &layouts[layout_of(block)];
+  if (layout->flags & GC_LAYOUT_NO_POINTERS) {
+    return 0;
+  }
+  end = ADD_BYTES(block, block_size(block));
+  if (end - p > SCAN_SLICE) {
+    push_mark(w, p + SCAN_SLICE + 1);
+    end = p + SCAN_SLICE;
+  }
+  if (layout->words > 0) {
+    scan_typed(w, layout, ADD_BYTES(block, kMetadataSize), (void **) p, (void **) end);
+  } else {
+    scan_range(w, p, end);
+  }
+  return end - p;
+}
+
+static void *find_mark_work(MarkWorker *w) {
+  void *entry = pop_mark(w);
+  if (entry == NULL) {
+    entry = pop_overflow();
+  }
+  for (int i = 1; entry == NULL && i < mark_threads; i++) {
+    entry = steal_mark(&workers[(w->id + i) % mark_threads]);
+  }
+  return entry;
+}
+
+/* Scans this worker's share of the roots, then marks until every worker runs
+   out of work. A worker only declares itself idle once its own deque is
+   empty and nobody pushes into it but itself, so all workers idle means the
+   mark is complete. */
+static void mark_worker(MarkWorker *w) {
+  size_t total = 0;
+  for (int i = 0; i < n_roots; i++) {
+    total += roots[i].hi - roots[i].lo;
+  }
+  size_t share_lo = round_up(total * w->id / mark_threads, kAlignment);
+  size_t share_hi = w->id == mark_threads - 1 ? total : round_up(total * (w->id + 1) / mark_threads, kAlignment);
+  size_t offset = 0;
+  for (int i = 0; i < n_roots; i++) {
+    size_t len = roots[i].hi - roots[i].lo;
+    size_t lo = share_lo > offset ? share_lo - offset : 0;
+    size_t hi = share_hi - offset < len ? share_hi - offset : len;
+    if (share_hi > offset && lo < hi) {
+      scan_range(w, roots[i].lo + lo, roots[i].lo + hi);
+    }
+    offset += len;
+  }
+
+  for (;;) {
+    void *entry = find_mark_work(w);
+    if (entry != NULL) {
+      scan_entry(w, entry);
+      continue;
+    }
+    __atomic_add_fetch(&idle_workers, 1, __ATOMIC_SEQ_CST);
+    for (;;) {
+      if (__atomic_load_n(&idle_workers, __ATOMIC_SEQ_CST) == mark_threads) {
+        return;
+      }
+      if (has_mark_work()) {
+        __atomic_sub_fetch(&idle_workers, 1, __ATOMIC_SEQ_CST);
+        break;
+      }
+      sched_yield();
+    }
+  }
+}
+
+static void *pool_main(void *arg) {
+  MarkWorker *w = arg;
+  unsigned long seen = 0;
+  for (;;) {
+    pthread_mutex_lock(&pool_lock);
+    while (pool_epoch == seen) {
+      pthread_cond_wait(&pool_start, &pool_lock);
+    }
+    seen = pool_epoch;
+    // Threads beyond the current thread count sit this collection out
+    int active = w->id < mark_threads;
+    pthread_mutex_unlock(&pool_lock);
+
+    if (active) {
+      mark_worker(w);
+      pthread_mutex_lock(&pool_lock);
+      if (++pool_finished == mark_threads - 1) {
+        pthread_cond_signal(&pool_done);
+      }
+      pthread_mutex_unlock(&pool_lock);
+    }
+  }
   return NULL;
 }
 
-void my_free(void *ptr) {
-  return; 
+static void prepare_workers(void) {
+  for (int i = 0; i < mark_threads; i++) {
+    if (workers[i].deque == NULL) {
+      workers[i].deque = mmap(NULL, DEQUE_SIZE * sizeof(void *), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (workers[i].deque == MAP_FAILED) {
+        fprintf(stderr, "mmap failed with error: %s\n", strerror(errno));
+        exit(1);
+      }
+      workers[i].id = i;
+    }
+  }
+}
+
+/* Marks everything reachable from `roots` and from the entries already pushed
+   using all mark threads. */
+static void mark_parallel(void) {
+  prepare_workers();
+  idle_workers = 0;
+  if (mark_threads == 1) {
+    mark_worker(&workers[0]);
+    return;
+  }
+
+  pthread_mutex_lock(&pool_lock);
+  while (pool_size < mark_threads - 1) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, pool_main, &workers[pool_size + 1]) != 0) {
+      fprintf(stderr, "pthread_create failed, marking with %d threads\n", pool_size + 1);
+      mark_threads = pool_size + 1;
+      break;
+    }
+    pthread_detach(thread);
+    pool_size++;
+  }
+  pool_finished = 0;
+  pool_epoch++;
+  pthread_cond_broadcast(&pool_start);
+  pthread_mutex_unlock(&pool_lock);
+
+  mark_worker(&workers[0]);
+
+  pthread_mutex_lock(&pool_lock);
+  while (pool_finished < mark_threads - 1) {
+    pthread_cond_wait(&pool_done, &pool_lock);
+  }
+  pthread_mutex_unlock(&pool_lock);
+}
+
+static void add_root(void *lo, void *hi) {
+  if (n_roots < MAX_ROOTS && (char *) lo < (char *) hi) {
+    roots[n_roots].lo = lo;
+    roots[n_roots].hi = hi;
+    n_roots++;
+  }
+}
+
+/* dl_iterate_phdr callback adding the writable segments (data and BSS) of the
+   main program, which is always reported first. */
+static int add_data_segments(struct dl_phdr_info *info, size_t size, void *data) {
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+    if (phdr->p_type == PT_LOAD && (phdr->p_flags & PF_W)) {
+      char *seg = (char *) (info->dlpi_addr + phdr->p_vaddr);
+      add_root(seg, seg + phdr->p_memsz);
+    }
+  }
+  return 1;
+}
+
+/* ================================= Sweeping ================================ */
+
+static void make_free_run(GCChunk *c, size_t from, size_t to) {
+  clear_start_range(c, from + 1, to);
+  set_start(c, from);
+  Block *block = granule_block(c, from);
+  block->size = 0;
+  set_block_size(block, (to - from) << GRANULE_SHIFT);
+  insert_free_block(block);
+}
+
+/* Called by the sweep for every marked block of the nursery: young blocks
+   age, and are promoted or have their mark cleared for the next minor
+   collection. A promoted block may point at young blocks, so its cards are
+   dirtied. */
+static void age_block(GCChunk *c, size_t g, Block *block) {
+  size_t size = block_size(block);
+  nursery_live += size;
+  int age = (block->size & AGE_MASK) >> AGE_SHIFT;
+  if (age == AGE_OLD) {
+    return;
+  }
+  if (++age >= promote_age) {
+    age = AGE_OLD;
+    dirty_cards(c, block, ADD_BYTES(block, size));
+    bytes_since_gc += size;
+    gc_stats.promoted_bytes += size;
+  } else {
+    clear_mark(c, g);
+  }
+  block->size = (block->size & ~AGE_MASK) | ((size_t) age << AGE_SHIFT);
+}
+
+/* Sweeps chunk c from sweep_word on, until `budget` granules were covered.
+   Returns 1 once the chunk is done. */
+static int sweep_chunk(GCChunk *c, size_t *budget) {
+  size_t words = bitmap_words(c->n_granules);
+  while (sweep_word < words) {
+    uint64_t bits = c->mark_bits[sweep_word];
+    while (bits) {
+      size_t g = (sweep_word << 6) + __builtin_ctzll(bits);
+      bits &= bits - 1;
+      Block *block = granule_block(c, g);
+      if (g > sweep_run) {
+        make_free_run(c, sweep_run, g);
+      }
+      sweep_run = g + (block_size(block) >> GRANULE_SHIFT);
+      gc_stats.live_bytes += block_size(block);
+      gc_stats.live_blocks++;
+      if (c == nursery) {
+        age_block(c, g, block);
+      }
+    }
+    sweep_word++;
+    if (*budget <= 64) {
+      return 0;
+    }
+    *budget -= 64;
+  }
+  if (sweep_run < c->n_granules) {
+    make_free_run(c, sweep_run, c->n_granules);
+  }
+  if (c == nursery) {
+    nursery_bytes = nursery_live;
+    nursery_live = 0;
+    nursery_cursor = (Block *) c->start;
+  }
+  c->swept = 1;
+  sweep_word = 0;
+  sweep_run = 0;
+  return 1;
 }
 
+/* Rebuilds the free lists from the mark bits: every gap between two marked
+   blocks becomes one free block. Sweeps until `budget` granules were covered
+   and returns 1 once every chunk is swept. */
+static int sweep_some(size_t budget) {
+  while (sweep_cursor != NULL) {
+    if (!sweep_chunk(sweep_cursor, &budget)) {
+      return 0;
+    }
+    sweep_cursor = sweep_cursor->next;
+  }
+  return 1;
+}
+
+static void begin_cycle(void) {
+  for (GCChunk *c = chunk_list; c != NULL; c = c->next) {
+    memset(c->mark_bits, 0, bitmap_words(c->n_granules) * sizeof(uint64_t));
+  }
+  prepare_workers();
+  alloc_log_len = 0;
+  gc_stats.last_mark_ns = 0;
+  gc_phase = GC_MARK;
+}
+
+static void begin_sweep(void) {
+  reset_bins();
+  for (GCChunk *c = chunk_list; c != NULL; c = c->next) {
+    c->swept = 0;
+  }
+  sweep_cursor = chunk_list;
+  sweep_word = 0;
+  sweep_run = 0;
+  sweep_garbage = allocated_bytes;
+  gc_stats.live_bytes = 0;
+  gc_stats.live_blocks = 0;
+  gc_phase = GC_SWEEP;
+}
+
+static void end_cycle(void) {
+  gc_stats.freed_bytes = sweep_garbage - gc_stats.live_bytes;
+  allocated_bytes -= gc_stats.freed_bytes;
+  bytes_since_gc = 0;
+  gc_stats.collections++;
+  gc_phase = GC_IDLE;
+}
+
+static void record_pause(uint64_t pause) {
+  gc_stats.last_pause_ns = pause;
+  gc_stats.total_pause_ns += pause;
+  if (pause > gc_stats.max_pause_ns) {
+    gc_stats.max_pause_ns = pause;
+  }
+}
+
+// Returns the current top of the stack (the frame of this call)
+__attribute__((noinline))
 void *get_end_of_stack() {
-  return __builtin_frame_address(1);
+  return __builtin_frame_address(0);
+}
+
+/* Spills the callee-saved registers into this frame and marks from everything
+   between them and the start of the stack, plus the data segment. The whole
+   mark runs below this frame so the workers never see the scanned part of the
+   stack change under them. */
+__attribute__((noinline))
+static void mark_from_roots(void) {
+  jmp_buf regs;
+  setjmp(regs);
+  n_roots = 0;
+  add_root(&regs, start_of_stack);
+  dl_iterate_phdr(add_data_segments, NULL);
+  mark_parallel();
+}
+
+/* Pushes the roots onto worker 0's deque without tracing them further, for
+   the first slice of an incremental cycle. */
+__attribute__((noinline))
+static void push_roots(void) {
+  jmp_buf regs;
+  setjmp(regs);
+  n_roots = 0;
+  add_root(&regs, start_of_stack);
+  dl_iterate_phdr(add_data_segments, NULL);
+  for (int i = 0; i < n_roots; i++) {
+    scan_range(&workers[0], roots[i].lo, roots[i].hi);
+  }
+}
+
+/* Traces from worker 0's deque until it runs out of entries (returns 1), or
+   the slice runs out of work or time (returns 0). */
+static int mark_some(size_t budget, uint64_t deadline) {
+  size_t done = 0;
+  for (int n = 1;; n++) {
+    void *entry = pop_mark(&workers[0]);
+    if (entry == NULL && (entry = pop_overflow()) == NULL) {
+      return 1;
+    }
+    done += scan_entry(&workers[0], entry);
+    if (done >= budget || (n % 32 == 0 && now_ns() >= deadline)) {
+      return 0;
+    }
+  }
+}
+
+/* Final remark of the mark phase, see the top of the file. */
+static void finish_mark(void) {
+  for (size_t i = 0; i < alloc_log_len; i++) {
+    push_mark(&workers[0], alloc_log[i]);
+  }
+  alloc_log_len = 0;
+  mark_from_roots();
+}
+
+/* Runs one slice of the current cycle, starting one if none is active.
+   Returns 1 if the cycle finished in this slice. */
+static int gc_slice(size_t work) {
+  uint64_t start = now_ns();
+  uint64_t deadline = slice_time_ns ? start + slice_time_ns : UINT64_MAX;
+  enum GCPhase phase = gc_phase;
+  int finished = 0;
+  if (phase == GC_IDLE) {
+    begin_cycle();
+    push_roots();
+  } else if (phase == GC_MARK) {
+    if (mark_some(work, deadline)) {
+      finish_mark();
+      begin_sweep();
+    }
+  } else if (sweep_some(work)) {
+    end_cycle();
+    finished = 1;
+  }
+  uint64_t pause = now_ns() - start;
+  if (phase != GC_SWEEP) {
+    gc_stats.last_mark_ns += pause;
+  }
+  gc_stats.slices++;
+  record_pause(pause);
+  return finished;
 }
 
 void my_gc() {
-  void *end_of_stack = get_end_of_stack();
+  if (start_of_stack == NULL || chunk_list == NULL) {
+    return;
+  }
+  // Finish an incremental cycle in progress first
+  while (gc_phase != GC_IDLE) {
+    gc_slice(SIZE_MAX);
+  }
+  uint64_t start = now_ns();
+
+  begin_cycle();
+  mark_from_roots();
+  gc_stats.last_mark_ns = now_ns() - start;
+  begin_sweep();
+  sweep_some(SIZE_MAX);
+  end_cycle();
+
+  record_pause(now_ns() - start);
+}
+
+/* Scans the parts of old blocks in card `card` of chunk c for pointers to
+   young blocks and greys them. Returns whether any were found. */
+static int scan_card(GCChunk *c, size_t card) {
+  size_t lo = card << 6;
+  size_t hi = lo + 64 < c->n_granules ? lo + 64 : c->n_granules;
+  int young = 0;
+  for (size_t g = find_start(c, lo); g < hi;) {
+    Block *block = granule_block(c, g);
+    size_t end = g + (block_size(block) >> GRANULE_SHIFT);
+    if (!is_free(block) && layout_of(block) != GC_NO_POINTERS && (c != nursery || ((block->size & AGE_MASK) >> AGE_SHIFT) == AGE_OLD)) {
+      void **p = g < lo ? (void **) granule_block(c, lo) : (void **) ADD_BYTES(block, kMetadataSize);
+      void **p_end = (void **) granule_block(c, end < hi ? end : hi);
+      for (; p < p_end; p++) {
+        if (in_nursery(*p) && is_pointer_slot(block, p)) {
+          GCChunk *tc = NULL;
+          Block *target = find_block(*p, &tc);
+          if (target != NULL && ((target->size & AGE_MASK) >> AGE_SHIFT) != AGE_OLD) {
+            young = 1;
+            shade(&workers[0], tc, target);
+          }
+        }
+      }
+    }
+    g = end;
+  }
+  return young;
+}
+
+/* Collects the nursery only. Everything outside it counts as live, see the
+   top of the file. */
+static void minor_gc(void) {
+  uint64_t start = now_ns();
+  prepare_workers();
+  for (GCChunk *c = chunk_list; c != NULL; c = c->next) {
+    size_t n_cards = bitmap_words(c->n_granules);
+    for (size_t i = 0; i < n_cards; i++) {
+      if (c->cards[i] && !scan_card(c, i)) {
+        c->cards[i] = 0;
+      }
+    }
+  }
+  mark_from_roots();
+  gc_stats.last_mark_ns = now_ns() - start;
+
+  size_t before = nursery_bytes;
+  size_t budget = SIZE_MAX;
+  gc_stats.live_bytes = 0;
+  gc_stats.live_blocks = 0;
+  sweep_word = 0;
+  sweep_run = 0;
+  sweep_chunk(nursery, &budget);
+  gc_stats.freed_bytes = before - nursery_bytes;
+  allocated_bytes -= gc_stats.freed_bytes;
+
+  uint64_t pause = now_ns() - start;
+  gc_stats.minor_collections++;
+  gc_stats.minor_pause_ns += pause;
+  record_pause(pause);
+}
+
+/* Makes the nursery part of the old generation: its blocks become old and
+   marked, its free blocks go to the bins. */
+static void retire_nursery(void) {
+  GCChunk *c = nursery;
+  if (c == NULL) {
+    return;
+  }
+  nursery = NULL;
+  for (Block *block = (Block *) c->start; (char *) block < c->end; block = ADD_BYTES(block, block_size(block))) {
+    if (is_free(block)) {
+      insert_free_block(block);
+    } else if ((block->size & AGE_MASK) != AGE_MASK) {
+      block->size |= AGE_MASK;
+      test_and_set_mark(c, granule_of(c, block));
+      gc_stats.promoted_bytes += block_size(block);
+    }
+  }
+  bytes_since_gc += nursery_bytes;
+  nursery_bytes = 0;
+}
+
+/* Maps a fresh nursery: a one-kMemorySize chunk cut down to nursery_size,
+   the rest of the mapping is never touched. */
+static void map_nursery(void) {
+  GCChunk *c = map_chunk(1);
+  Block *block = (Block *) c->start;
+  remove_free_block(block);
+  size_t size = nursery_size < (size_t) (c->end - c->start) ? nursery_size : (size_t) (c->end - c->start);
+  gc_stats.heap_size -= (c->end - c->start) - size;
+  c->end = c->start + size;
+  c->n_granules = size >> GRANULE_SHIFT;
+  set_block_size(block, size);
+  nursery = c;
+  nursery_cursor = block;
+}
+
+/* Allocates `size` bytes from the nursery, continuing the walk from the last
+   allocation. Returns NULL when the walk reaches the end. */
+static Block *nursery_alloc(size_t size) {
+  Block *block = nursery_cursor;
+  while ((char *) block < nursery->end) {
+    if (is_free(block) && block_size(block) >= size) {
+      allocate_block(block, size);
+      nursery_cursor = ADD_BYTES(block, block_size(block));
+      nursery_bytes += block_size(block);
+      return block;
+    }
+    block = ADD_BYTES(block, block_size(block));
+  }
+  nursery_cursor = block;
+  return NULL;
+}
+
+/* Allocates a young block, collecting the nursery when it is full. */
+static Block *allocate_young(size_t size) {
+  if (nursery == NULL) {
+    map_nursery();
+  }
+  Block *block = nursery_alloc(size);
+  if (block == NULL) {
+    minor_gc();
+    // Replace the nursery once old blocks fill three quarters of it
+    if (4 * nursery_bytes > 3 * (size_t) (nursery->end - nursery->start)) {
+      retire_nursery();
+      map_nursery();
+    }
+    block = nursery_alloc(size);
+  }
+  return block;
+}
+
+int my_gc_step(size_t budget) {
+  if (start_of_stack == NULL || chunk_list == NULL) {
+    return 0;
+  }
+  return gc_slice(budget ? budget : slice_work);
+}
+
+void my_gc_set_incremental(int enabled, size_t work, uint64_t time_ns) {
+  if (enabled && generational) {
+    my_gc_set_generational(0, 0, 0);
+  }
+  incremental = enabled;
+  if (work > 0) {
+    slice_work = work;
+  }
+  slice_time_ns = time_ns;
+}
+
+void my_gc_set_generational(int enabled, size_t nursery_bytes_max, int promote_after) {
+  while (gc_phase != GC_IDLE) {
+    gc_slice(SIZE_MAX);
+  }
+  if (nursery_bytes_max > 0) {
+    nursery_size = round_up(nursery_bytes_max, 1 << CARD_SHIFT);
+  }
+  if (promote_after > 0) {
+    promote_age = promote_after < AGE_OLD ? promote_after : AGE_OLD;
+  }
+  if (!enabled) {
+    retire_nursery();
+  } else if (!generational) {
+    // Blocks allocated so far are old: mark them so minor collections
+    // don't trace them
+    for (GCChunk *c = chunk_list; c != NULL; c = c->next) {
+      for (Block *block = (Block *) c->start; (char *) block < c->end; block = ADD_BYTES(block, block_size(block))) {
+        if (!is_free(block)) {
+          test_and_set_mark(c, granule_of(c, block));
+        }
+      }
+    }
+    incremental = 0;
+  }
+  generational = enabled;
+}
+
+/* Stores `value` into the heap slot `slot`. In generational mode a pointer
+   into the nursery dirties the card of the slot. While marking, the new
+   target is shaded grey so a block that already was scanned can't hide it. */
+void my_gc_write_barrier(void **slot, void *value) {
+  *slot = value;
+  if (in_nursery(value)) {
+    GCChunk *c = chunk_of(slot);
+    if (c != NULL) {
+      c->cards[(size_t) ((char *) slot - c->start) >> CARD_SHIFT] = 1;
+    }
+  }
+  if (gc_phase == GC_MARK) {
+    GCChunk *c = NULL;
+    Block *block = find_block(value, &c);
+    if (block != NULL) {
+      shade(&workers[0], c, block);
+    }
+  }
+}
+
+static void log_allocation(Block *block) {
+  if (alloc_log_len == alloc_log_cap) {
+    size_t new_cap = alloc_log_cap ? 2 * alloc_log_cap : 4096;
+    Block **log = mmap(NULL, new_cap * sizeof(Block *), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (log == MAP_FAILED) {
+      fprintf(stderr, "mmap failed with error: %s\n", strerror(errno));
+      exit(1);
+    }
+    if (alloc_log != NULL) {
+      memcpy(log, alloc_log, alloc_log_len * sizeof(Block *));
+      munmap(alloc_log, alloc_log_cap * sizeof(Block *));
+    }
+    alloc_log = log;
+    alloc_log_cap = new_cap;
+  }
+  alloc_log[alloc_log_len++] = block;
+}
+
+void *my_malloc(size_t size) {
+  if (size == 0 || size > kMaxAllocationSize) {
+    return NULL;
+  }
+  if (!is_initialized) {
+    reset_bins();
+    if (mark_threads == 0) {
+      const char *env = getenv("MYGC_THREADS");
+      my_gc_set_threads(env != NULL ? atoi(env) : 1);
+    }
+    my_trace_init();
+    is_initialized = 1;
+  }
+  size_t alloc_size = round_up(kMetadataSize + size, kAlignment);
+  if (alloc_size < kMinBlockSize) {
+    alloc_size = kMinBlockSize;
+  }
+
+  if (generational && start_of_stack != NULL && alloc_size <= kMaxNurseryBlock) {
+    Block *block = allocate_young(alloc_size);
+    if (block != NULL) {
+      allocated_bytes += block_size(block);
+      MY_TRACE(MY_TRACE_ALLOC, ADD_BYTES(block, kMetadataSize), size, block_size(block));
+      return ADD_BYTES(block, kMetadataSize);
+    }
+  }
+
+  int may_collect = start_of_stack != NULL && gc_stats.heap_size > 0;
+  if (incremental && may_collect) {
+    // Start a cycle once half the heap was allocated since the last one, and
+    // run a slice every kSliceAllocBytes while it is active
+    if (gc_phase == GC_IDLE ? 2 * bytes_since_gc >= gc_stats.heap_size : (alloc_credit += alloc_size) >= kSliceAllocBytes) {
+      alloc_credit = 0;
+      gc_slice(slice_work);
+    }
+  }
+
+  Block *block = take_free_block(alloc_size);
+  // Lazily sweep further before growing the heap
+  while (block == NULL && gc_phase == GC_SWEEP) {
+    gc_slice(slice_work);
+    block = take_free_block(alloc_size);
+  }
+  // Collect before growing the heap once half of it was allocated since the
+  // last collection
+  if (block == NULL && !incremental && may_collect && 2 * bytes_since_gc >= gc_stats.heap_size) {
+    my_gc();
+    block = take_free_block(alloc_size);
+  }
+  if (block == NULL) {
+    map_chunk(get_chunk_size(alloc_size));
+    block = take_free_block(alloc_size);
+  }
+  allocate_block(block, alloc_size);
+  if (gc_phase != GC_IDLE) {
+    // Allocate black; blocks allocated while marking are rescanned at the end
+    GCChunk *c = chunk_of(block);
+    test_and_set_mark(c, granule_of(c, block));
+    if (gc_phase == GC_MARK) {
+      log_allocation(block);
+    }
+  } else if (generational) {
+    // Old from the start: marked like the rest of the old generation, and
+    // its cards dirty as it will be initialised without the write barrier
+    GCChunk *c = chunk_of(block);
+    test_and_set_mark(c, granule_of(c, block));
+    dirty_cards(c, block, ADD_BYTES(block, block_size(block)));
+  }
+  allocated_bytes += block_size(block);
+  bytes_since_gc += block_size(block);
+  MY_TRACE(MY_TRACE_ALLOC, ADD_BYTES(block, kMetadataSize), size, block_size(block));
+  return ADD_BYTES(block, kMetadataSize);
+}
+
+int my_gc_register_layout(const struct GCLayout *layout) {
+  if (layout->flags & GC_LAYOUT_NO_POINTERS) {
+    return GC_NO_POINTERS;
+  }
+  if (layout->words == 0 || layout->words > 64) {
+    return -1;
+  }
+  uint64_t bits = layout->words == 64 ? layout->pointer_bits : layout->pointer_bits & ((1ull << layout->words) - 1);
+  if (bits == 0) {
+    return GC_NO_POINTERS;
+  }
+  for (int i = 2; i < n_layouts; i++) {
+    if (layouts[i].words == layout->words && layouts[i].pointer_bits == bits) {
+      return i;
+    }
+  }
+  if (n_layouts == MAX_LAYOUTS) {
+    return -1;
+  }
+  layouts[n_layouts].flags = 0;
+  layouts[n_layouts].words = layout->words;
+  layouts[n_layouts].pointer_bits = bits;
+  return n_layouts++;
+}
+
+void *my_malloc_typed(size_t size, int layout) {
+  if (layout < 0 || layout >= n_layouts) {
+    return NULL;
+  }
+  void *ptr = my_malloc(size);
+  if (ptr != NULL) {
+    Block *block = ptr_to_block(ptr);
+    block->size = (block->size & ~LAYOUT_MASK) | ((size_t) layout << LAYOUT_SHIFT);
+  }
+  return ptr;
+}
+
+void my_free(void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+  GCChunk *c = NULL;
+  Block *block = find_block(ptr, &c);
+  if (block == NULL || block != ptr_to_block(ptr)) {
+    return;
+  }
+  MY_TRACE(MY_TRACE_FREE, ptr, block_size(block), 0);
+  allocated_bytes -= block_size(block);
+  size_t g = granule_of(c, block);
+  // Marks are sticky in generational mode, drop it along with the block
+  clear_mark(c, g);
+  if (c == nursery) {
+    nursery_bytes -= block_size(block);
+  }
+  if (is_unswept(c, g)) {
+    // The sweep will fold it into a free run
+    set_allocated(block, 0);
+    sweep_garbage -= block_size(block);
+    return;
+  }
+  release_block(c, block);
+}
+
+void my_free_sized(void *ptr, size_t size) {
+  my_free(ptr);
+}
+
+void *my_malloc_flags(size_t size, int flags) {
+  return my_malloc(size);
+}
+
+void *my_calloc(size_t count, size_t size) {
+  size_t bytes;
+  if (__builtin_mul_overflow(count, size, &bytes)) {
+    return NULL;
+  }
+  void *ptr = my_malloc(bytes);
+  if (ptr != NULL) {
+    memset(ptr, 0, bytes);
+  }
+  return ptr;
+}
+
+void *my_realloc(void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return my_malloc(size);
+  }
+  if (size == 0) {
+    my_free(ptr);
+    return NULL;
+  }
+  size_t capacity = block_size(ptr_to_block(ptr)) - kMetadataSize;
+  if (size <= capacity) {
+    return ptr;
+  }
+  void *new_ptr = my_malloc(size);
+  if (new_ptr != NULL) {
+    memcpy(new_ptr, ptr, capacity);
+    my_free(ptr);
+  }
+  return new_ptr;
+}
+
+
+void my_gc_get_stats(struct GCStats *stats) {
+  *stats = gc_stats;
+}
+
+void my_gc_set_threads(int n) {
+  if (n < 1) {
+    n = 1;
+  }
+  mark_threads = n < MAX_MARK_THREADS ? n : MAX_MARK_THREADS;
+}
+
+/** Block helpers, same encoding as mymalloc.c: the allocated flag lives in the
+ *  low bit of the size. The next two bits hold the age of the block and the
+ *  top 16 its layout.
+ **/
+void set_allocated(Block *block, int allocated) {
+  if (allocated) {
+    block->size |= ALLOCATED_MASK;
+  } else {
+    block->size &= ~ALLOCATED_MASK;
+  }
+}
+
+int is_free(Block *block) {
+  return (block->size & ALLOCATED_MASK) == 0;
+}
+
+void set_block_size(Block *block, size_t new_size) {
+  block->size = (block->size & HEADER_BITS) | (new_size & ~HEADER_BITS);
+}
+
+size_t block_size(Block *block) {
+  return block->size & ~HEADER_BITS;
+}
+
+Block *ptr_to_block(void *ptr) {
+  return ADD_BYTES(ptr, -((size_t) kMetadataSize));
+}
 
-  // TODO
+Linker *get_linker(Block *block) {
+  return ADD_BYTES(block, kMetadataSize);
 }
@@ -1,11 +1,99 @@
 #ifndef MYGC_HEADER
 #define MYGC_HEADER
 
+// The collector doesn't scan the thread caches, see mymalloc.h
+#ifndef NO_THREAD_CACHE
+#define NO_THREAD_CACHE
+#endif
 #include "mymalloc.h"
 #include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Collector statistics, filled in by `my_gc_get_stats`. Byte counts include
+   block headers. */
+struct GCStats {
+  // Number of completed collections
+  size_t collections;
+  // Bytes of block space in all chunks
+  size_t heap_size;
+  // Bytes in blocks that survived the last collection (for a minor
+  // collection, of the nursery)
+  size_t live_bytes;
+  // Number of blocks that survived the last collection
+  size_t live_blocks;
+  // Bytes reclaimed by the last collection
+  size_t freed_bytes;
+  // Time spent marking in the last collection
+  uint64_t last_mark_ns;
+  // Number of incremental slices run
+  size_t slices;
+  // Number of minor collections, their pauses summed, and the bytes of
+  // blocks promoted to the old generation in all collections
+  size_t minor_collections;
+  uint64_t minor_pause_ns;
+  size_t promoted_bytes;
+  // Pause times of the last collection (or slice), the worst one and all of
+  // them summed
+  uint64_t last_pause_ns;
+  uint64_t max_pause_ns;
+  uint64_t total_pause_ns;
+};
 
 void set_start_of_stack(void *start_addr);
 void *get_end_of_stack(void);
 void my_gc(void);
+void my_gc_get_stats(struct GCStats *stats);
+/* Number of threads marking in parallel (default: $MYGC_THREADS or 1). */
+void my_gc_set_threads(int n);
+
+/* Incremental mode: my_malloc runs collection slices of at most `work` bytes
+   of scanning (default 256 KB) and, if `time_ns` is non-zero, about that much
+   time. Pointers stored into existing blocks must then go through
+   my_gc_write_barrier. */
+void my_gc_set_incremental(int enabled, size_t work, uint64_t time_ns);
+/* Runs one slice of `budget` bytes of work (0: the default), starting a cycle
+   if none is active. Returns 1 if a cycle finished. */
+int my_gc_step(size_t budget);
+/* Generational mode: blocks of up to 4 KB are allocated in a nursery of
+   `nursery_bytes` (default 4 MB) and promoted after surviving
+   `promote_after` collections (1-3, default 2). Collections of the nursery
+   run when it is full; my_gc still collects everything. Pointers stored into
+   existing blocks must then go through my_gc_write_barrier. Turns
+   incremental mode off, and vice versa. 0 keeps the current setting. */
+void my_gc_set_generational(int enabled, size_t nursery_bytes, int promote_after);
+/* *slot = value, telling an active incremental cycle or the card table about
+   the new pointer. */
+void my_gc_write_barrier(void **slot, void *value);
+
+/* Pointer layout for my_malloc_typed: an element of `words` words (1-64)
+   where bit i of `pointer_bits` is set if word i may hold a pointer. The
+   element repeats over the whole payload, so an array of structs uses the
+   layout of one struct. With GC_LAYOUT_NO_POINTERS the block is never
+   scanned and the other fields are ignored. */
+#define GC_LAYOUT_NO_POINTERS 1
+
+struct GCLayout {
+  unsigned flags;
+  size_t words;
+  uint64_t pointer_bits;
+};
+
+// Predefined layout ids: scanned conservatively (like my_malloc), no pointers
+#define GC_UNTYPED 0
+#define GC_NO_POINTERS 1
+
+/* Returns the id of the layout for my_malloc_typed, or -1 if it is invalid or
+   too many layouts were registered. */
+int my_gc_register_layout(const struct GCLayout *layout);
+/* my_malloc for a block whose pointers are only where `layout` says. */
+void *my_malloc_typed(size_t size, int layout);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
@@ -1,4 +1,20 @@
+#define _GNU_SOURCE
 #include "mymalloc.h"
+#include "mypages.h"
+#include "myprofile.h"
+#include "mystream.h"
+#include "mytrace.h"
+#ifdef COMPACT_HEADERS
+#include "size_classes_compact.h"
+#else
+#include "size_classes.h"
+#endif
+#include <linux/mempolicy.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 // Word alignment
 const size_t kAlignment = sizeof(size_t);
@@ -8,46 +24,489 @@ const size_t kMinAllocationSize = kAlignment;
 const size_t kMetadataSize = sizeof(Block);
 // const size_t kFreeMetadataSize = sizeof(FreeBlock);
 const size_t kLinkMetadataSize = sizeof(Linker);
-// Maximum allocation size (128 MB)
-const size_t kMaxAllocationSize = (128ull << 20) - 4 * kLinkMetadataSize;
+// Maximum allocation size (4 GB)
+const size_t kMaxAllocationSize = (4ull << 30);
 // Memory size that is mmapped (64 MB)
 const size_t kMemorySize = (64ull << 20);
+// Bytes a heap first grows by, later growths double up to kMemorySize
+const size_t kInitialChunkSize = (64ull << 10);
 
 const size_t kAvailableSize = kMemorySize - 2 * kLinkMetadataSize;
-
-Linker *free_list_head = NULL;
-Linker *free_list_tail = NULL;
+#ifdef COMPACT_HEADERS
+// Smallest block: header, free list links and footer
+const size_t kMinBlockSize = 2 * sizeof(Block) + sizeof(Linker);
+#else
+const size_t kMinBlockSize = 2 * sizeof(Block) + sizeof(Linker) + kMinAllocationSize;
+#endif
+
+// The initial-exec model avoids a __tls_get_addr call per access from the
+// library
+#define THREAD_LOCAL __thread __attribute__((tls_model("initial-exec")))
 Block *cur_free_block = NULL;
 
 static int is_requested_memory = 0;
 
-static struct ChunkInfo chunk_arr[128];
-int chunk_idx = 0;
-
 size_t kHeapSize = 0ull;
 // static int chunk_idx = 0;
 
 Block *cur_fencepost_start = NULL, *cur_fencepost_end = NULL;
 
+/** NUMA: every node has a heap of its own, with its own free list, chunks
+ *  bound to the node with mbind and a lock, so threads on different nodes
+ *  don't contend. A thread allocates from the heap of the node it is running
+ *  on (getcpu), and a freed block goes back to the heap of its chunk, so it
+ *  is only reused on that node. On a single node, or with MYMALLOC_NUMA=0 in
+ *  the environment, there is one heap and chunks aren't bound.
+ **/
+#define MAX_NODES 64
+
+struct NodeHeap {
+  // Head and tail of the free list of each size class (see size_classes.h),
+  // and last of the blocks larger than MAX_CLASS_SIZE, in list_heads
+  Linker (*free_lists)[2];
+  // Bit i is set if free list i isn't empty
+  unsigned long long nonempty;
+  // Bytes to grow by next, see next_chunk_bytes
+  size_t next_chunk_size;
+  pthread_mutex_t lock;
+  // The heap's one chunk, whose end fencepost moves up as it grows (see
+  // grow_chunk)
+  struct ChunkInfo chunk;
+  // Start of the wilderness, or the end fencepost if it is empty
+  Block *wilderness;
+  // End of the part of its range made accessible, and of the range
+  char *committed;
+  char *limit;
+};
+
+static struct NodeHeap node_heaps[MAX_NODES];
+#ifdef COMPACT_HEADERS
+// At the start of the region, where links can point to them
+static Linker (*list_heads)[N_SIZE_CLASSES + 1][2] = NULL;
+#else
+static Linker list_heads[MAX_NODES][N_SIZE_CLASSES + 1][2];
+#endif
+// Heap the calling thread has locked, which the free list functions work on
+THREAD_LOCAL struct NodeHeap *cur_heap = NULL;
+static int node_count = 1;
+static pthread_once_t heaps_once = PTHREAD_ONCE_INIT;
+
+/** Heap range: the heaps live in a range of kRegionSize bytes reserved at
+ *  initialisation with PROT_NONE and MAP_NORESERVE, which costs address
+ *  space only, split evenly between the nodes. Each heap is a single chunk
+ *  at the bottom of its share that grows up through it: the end fencepost
+ *  becomes the header of the memory added past it, which merges with the
+ *  last block if that is free, so free space never stops at a chunk edge.
+ *  The range is made accessible kMemorySize bytes at a time, ahead of the
+ *  chunk. A block is the heap's if it lies between the fenceposts of the
+ *  heap of its share, which is a division away.
+ *
+ *  A block of kReleaseSize bytes or more that is freed gives the pages
+ *  inside it back to the kernel, so a heap that is mostly free doesn't hold
+ *  on to memory it isn't using. The slabs of the thread cache are spans of
+ *  the page heap (see mypages.h), mapped outside the range.
+ *
+ *  A heap's share can be larger than a compact size tag holds, so no block
+ *  grows past kMaxBlockSize: a freed block that would stays apart from the
+ *  neighbour it would merge with, and a growth that would take the
+ *  wilderness past it leaves the old wilderness behind as a free block.
+ **/
+#ifdef COMPACT_HEADERS
+// Bounded by the 32 bit word offsets of the links
+const size_t kRegionSize = (32ull << 30);
+// A page short of the 4 GB a 32 bit size tag can't hold
+const size_t kMaxBlockSize = (4ull << 30) - (4ull << 10);
+#else
+const size_t kRegionSize = (256ull << 30);
+const size_t kMaxBlockSize = (256ull << 30);
+#endif
+const size_t kReleaseSize = (64ull << 10);
+
+static char *region_base = NULL;
+// Start of the first heap's share, and the size of each share
+static char *heaps_base = NULL;
+static size_t heap_range = 0;
+
+/** Wilderness: the free top of a chunk, up to its end fencepost, is kept
+ *  out of the free lists. Growing the chunk adds to it, and a freed block
+ *  that reaches the end fencepost goes back to it. A block is only carved
+ *  off its bottom when no free block fits, so the wilderness lasts, and a
+ *  growing program allocates by moving the start of the wilderness up
+ *  rather than by splitting a large free block its best fit search has to
+ *  find. The wilderness has a free block's header, so the chunk can still be
+ *  walked block by block.
+ **/
+
+/** Spare chunk: with MYMALLOC_SPARE_CHUNK=1 in the environment, a background
+ *  thread faults in the first kSpareFaultSize bytes of the next kMemorySize
+ *  the heap will grow by, ahead of time (the wilderness is used from the
+ *  bottom up, so that is where new memory is used first). Every growth by
+ *  kMemorySize wakes it for the next, and the heap keeps that much more of
+ *  its range accessible for it. It faults pages in with MADV_POPULATE_WRITE,
+ *  which leaves their contents alone, as the heap may reach them first;
+ *  without it there is no spare thread.
+ **/
+const size_t kSpareFaultSize = (4ull << 20);
+
+static int spare_enabled = 0;
+// Memory for the thread to fault in, NULL once it has
+static char *spare_from = NULL;
+static pthread_mutex_t spare_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t spare_wanted = PTHREAD_COND_INITIALIZER;
+
+/** Placement: my_malloc_flags(size, MY_MALLOC_CACHE_LINE) starts the payload
+ *  on a cache line and pads it to whole lines, so no other block's payload
+ *  shares them and threads writing blocks allocated side by side don't false
+ *  share. MY_MALLOC_PAGE does the same with pages. MYMALLOC_PLACEMENT=line
+ *  (or page) in the environment applies it to every my_malloc of up to
+ *  kPlacementMaxSize bytes.
+ *
+ *  Colouring: with MYMALLOC_COLOUR=1, each node's heap starts a cache line
+ *  further into the page than the last node's, cycling through the page, so
+ *  the first blocks of heaps that allocate alike don't all map to the same
+ *  cache sets. Only the offset within a page is ours to pick, the physical
+ *  page decides the rest of an L2 set index.
+ **/
+const size_t kCacheLineSize = 64;
+const size_t kPageSize = 4096;
+const size_t kPlacementMaxSize = 4096;
+
+static int placement_flags = 0;
+static int colour_enabled = 0;
+
 
 inline static size_t round_up(size_t size, size_t alignment) {
   const size_t mask = alignment - 1;
   return (size + mask) & ~mask;
 }
 
+#ifdef COMPACT_HEADERS
+/** Compact headers: free list links are word offsets into the heap range,
+ *  which starts with the free list heads, so the range is bounded to the
+ *  32 GB a 32 bit word offset reaches.
+ **/
+static char *link_base = NULL;
+
+inline static Linker *link_at(uint32_t offset) {
+  return offset != 0 ? (Linker *) (link_base + ((size_t) offset << 3)) : NULL;
+}
+
+inline static uint32_t link_offset(Linker *link) {
+  return link != NULL ? (uint32_t) (((char *) link - link_base) >> 3) : 0;
+}
+
+inline static Linker *next_link(Linker *link) {
+  return link_at(link->next);
+}
+
+inline static Linker *prev_link(Linker *link) {
+  return link_at(link->prev);
+}
+
+inline static void set_next_link(Linker *link, Linker *next) {
+  link->next = link_offset(next);
+}
+
+inline static void set_prev_link(Linker *link, Linker *prev) {
+  link->prev = link_offset(prev);
+}
+
+#else
+inline static Linker *next_link(Linker *link) {
+  return link->next;
+}
+
+inline static Linker *prev_link(Linker *link) {
+  return link->prev;
+}
+
+inline static void set_next_link(Linker *link, Linker *next) {
+  link->next = next;
+}
+
+inline static void set_prev_link(Linker *link, Linker *prev) {
+  link->prev = prev;
+}
+#endif
+
+static void start_spare_thread();
+static void *heap_memory(size_t size);
+
+#ifdef ENABLE_HISTOGRAM
+/** Histogram build (make HISTOGRAM=1): counts the requested sizes and
+ *  appends them at exit to $MYMALLOC_HISTOGRAM (default
+ *  mymalloc-histogram.txt) as the "size count" lines sizeclasses.py reads.
+ *  Sizes above HISTOGRAM_SIZE are counted together.
+ **/
+#define HISTOGRAM_SIZE 65536
+
+static size_t size_histogram[HISTOGRAM_SIZE + 2];
+
+static void record_size(size_t size) {
+  __atomic_fetch_add(&size_histogram[size <= HISTOGRAM_SIZE ? size : HISTOGRAM_SIZE + 1], 1, __ATOMIC_RELAXED);
+}
+
+static void write_histogram() {
+  const char *path = getenv("MYMALLOC_HISTOGRAM");
+  FILE *f = fopen(path != NULL ? path : "mymalloc-histogram.txt", "a");
+  if (f == NULL) {
+    fprintf(stderr, "cannot write histogram: %s\n", strerror(errno));
+    return;
+  }
+  for (size_t size = 1; size <= HISTOGRAM_SIZE; size++) {
+    if (size_histogram[size] > 0) {
+      fprintf(f, "%zu %zu\n", size, size_histogram[size]);
+    }
+  }
+  if (size_histogram[HISTOGRAM_SIZE + 1] > 0) {
+    fprintf(f, ">%d %zu\n", HISTOGRAM_SIZE, size_histogram[HISTOGRAM_SIZE + 1]);
+  }
+  fclose(f);
+}
+#endif
+
+/* Returns the free list of a free block of `size` bytes: that of the largest
+   class it holds. Every free block holds the smallest class. */
+static int free_list_of(size_t size) {
+  if (size > MAX_CLASS_SIZE) {
+    return N_SIZE_CLASSES;
+  }
+  int c = kSizeClass[size / kAlignment];
+  return kClassSize[c] > size ? c - 1 : c;
+}
+
+/* Rounds a block size up to its class, if it has one. */
+static size_t class_size(size_t size) {
+  return size <= MAX_CLASS_SIZE ? kClassSize[kSizeClass[size / kAlignment]] : size;
+}
+
+/* Returns the number of NUMA nodes, 1 if the machine has a single one or
+   MYMALLOC_NUMA=0. Reads sysfs with read(2), as stdio may call malloc. */
+static int count_nodes() {
+  const char *env = getenv("MYMALLOC_NUMA");
+  if (env != NULL && atoi(env) == 0) {
+    return 1;
+  }
+  char buf[256];
+  int fd = open("/sys/devices/system/node/online", O_RDONLY);
+  if (fd < 0) {
+    return 1;
+  }
+  ssize_t len = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (len <= 0) {
+    return 1;
+  }
+  buf[len] = '\0';
+  // A list of ranges like "0-1,3": the last number is the highest node
+  int highest = 0;
+  for (char *c = buf; *c != '\0'; c++) {
+    if (*c >= '0' && *c <= '9') {
+      highest = (int) strtol(c, &c, 10);
+      c--;
+    }
+  }
+  return highest < MAX_NODES ? highest + 1 : MAX_NODES;
+}
+
+/* Reserves the heap range, without memory behind it until commit_heap, and
+   splits it between the nodes. */
+static void reserve_region() {
+  region_base = mmap(NULL, kRegionSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (region_base == MAP_FAILED) {
+    fprintf(stderr, "mmap failed with error: %s\n", strerror(errno));
+    exit(1);
+  }
+  heaps_base = region_base;
+#ifdef COMPACT_HEADERS
+  link_base = region_base;
+  // Offset 0 is the null link, so the heads start a word in
+  size_t heads = round_up(kAlignment + MAX_NODES * sizeof(*list_heads), kPageSize);
+  if (mprotect(region_base, heads, PROT_READ | PROT_WRITE) != 0) {
+    fprintf(stderr, "mmap failed with error: %s\n", strerror(errno));
+    exit(1);
+  }
+  list_heads = ADD_BYTES(region_base, kAlignment);
+  heaps_base += heads;
+#endif
+  heap_range = ((kRegionSize - (heaps_base - region_base)) / node_count) & ~(kPageSize - 1);
+}
+
+/* Has the kernel place the pages of [mem, mem + size) on `node`. Preferred
+   rather than strictly bound, so a full node falls back to the others
+   instead of failing the page fault. */
+static void bind_to_node(void *mem, size_t size, int node) {
+  unsigned long mask = 1ul << node;
+  syscall(SYS_mbind, mem, size, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0);
+}
+
+/* Makes the range of the locked heap of `node` accessible up to `end`, and
+   kMemorySize bytes further for the spare thread, in steps of kMemorySize
+   bytes. Exits if the range is used up. */
+static void commit_heap(struct NodeHeap *heap, int node, char *end) {
+  if (end > heap->limit) {
+    fprintf(stderr, "mmap failed with error: %s\n", strerror(ENOMEM));
+    exit(1);
+  }
+  if (end <= heap->committed) {
+    return;
+  }
+  size_t size = round_up(end - heap->committed + (spare_enabled ? kMemorySize : 0), kMemorySize);
+  if (size > (size_t) (heap->limit - heap->committed)) {
+    size = heap->limit - heap->committed;
+  }
+  if (mprotect(heap->committed, size, PROT_READ | PROT_WRITE) != 0) {
+    fprintf(stderr, "mmap failed with error: %s\n", strerror(errno));
+    exit(1);
+  }
+  if (node_count > 1) {
+    bind_to_node(heap->committed, size, node);
+  }
+  heap->committed += size;
+}
+
 void initialize() {
-  // Allocate memory for the head and tail of the free list using mmap
-  free_list_head = (Linker *)mmap(NULL, kLinkMetadataSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-  free_list_tail = (Linker *)mmap(NULL, kLinkMetadataSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  node_count = count_nodes();
+  const char *colour = getenv("MYMALLOC_COLOUR");
+  colour_enabled = colour != NULL && atoi(colour) != 0;
+  reserve_region();
+  start_spare_thread();
+  for (int i = 0; i < node_count; i++) {
+    struct NodeHeap *heap = &node_heaps[i];
+    heap->free_lists = list_heads[i];
+    heap->next_chunk_size = kInitialChunkSize;
+    pthread_mutex_init(&heap->lock, NULL);
+    // Set up the linked lists
+    for (int list = 0; list <= N_SIZE_CLASSES; list++) {
+      set_next_link(&heap->free_lists[list][0], &heap->free_lists[list][1]);
+      set_prev_link(&heap->free_lists[list][1], &heap->free_lists[list][0]);
+    }
+    // An empty chunk, the fenceposts side by side, which grow_heap grows
+    char *start = heaps_base + i * heap_range;
+    heap->committed = start;
+    heap->limit = start + heap_range;
+    size_t offset = colour_enabled ? (i * kCacheLineSize) % kPageSize : 0;
+    commit_heap(heap, i, start + offset + 2 * kMetadataSize);
+    Block *fencepost_start = (Block *) (start + offset);
+    set_block_size(fencepost_start, kMetadataSize);
+    set_allocated(fencepost_start, 1);
+    Block *fencepost_end = ADD_BYTES(fencepost_start, kMetadataSize);
+    set_block_size(fencepost_end, kMetadataSize);
+    set_allocated(fencepost_end, 1);
+    heap->chunk.fencepost_start = fencepost_start;
+    heap->chunk.fencepost_end = fencepost_end;
+    heap->chunk.block_start = fencepost_end;
+    heap->chunk.node = i;
+    heap->wilderness = fencepost_end;
+  }
+  my_pages_init(heap_memory);
+  my_cache_slabs = 1;
+  my_trace_init();
+  my_stream_init();
+  const char *placement = getenv("MYMALLOC_PLACEMENT");
+  if (placement != NULL) {
+    placement_flags = strcmp(placement, "page") == 0 ? MY_MALLOC_PAGE : strcmp(placement, "line") == 0 ? MY_MALLOC_CACHE_LINE : 0;
+  }
+#ifdef ENABLE_HISTOGRAM
+  atexit(write_histogram);
+#endif
+}
+
+/* Returns the node the calling thread is running on. */
+static int current_node() {
+  unsigned cpu, node;
+  if (node_count == 1 || getcpu(&cpu, &node) != 0 || node >= (unsigned) node_count) {
+    return 0;
+  }
+  return (int) node;
+}
+
+/* Locks the heap and makes its free lists the ones the free list functions
+   work on. */
+static void lock_heap(struct NodeHeap *heap) {
+  pthread_mutex_lock(&heap->lock);
+  cur_heap = heap;
+}
+
+static void unlock_heap(struct NodeHeap *heap) {
+  pthread_mutex_unlock(&heap->lock);
+}
+
+/* Returns the heap whose chunk a block is in, or NULL if it isn't in one:
+   the heap of the share of the range it is in, if it lies between that
+   heap's fenceposts. */
+static struct NodeHeap *heap_of(Block *block) {
+  uintptr_t offset = (uintptr_t) block - (uintptr_t) heaps_base;
+  // No heap_range before initialize
+  if (offset >= node_count * heap_range) {
+    return NULL;
+  }
+  struct NodeHeap *heap = &node_heaps[node_count == 1 ? 0 : offset / heap_range];
+  Block *fencepost_end = __atomic_load_n(&heap->chunk.fencepost_end, __ATOMIC_ACQUIRE);
+  if (block < ADD_BYTES(heap->chunk.fencepost_start, kMetadataSize) || block >= fencepost_end) {
+    return NULL;
+  }
+  return heap;
+}
 
-  if (free_list_head == MAP_FAILED || free_list_tail == MAP_FAILED) {
-    fprintf(stderr, "mmap failed to allocate memory for free list head or tail.\n");
+/* Memory for the page heap. */
+static void *heap_memory(size_t size) {
+  is_requested_memory = 1;
+  void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    fprintf(stderr, "mmap failed with error: %s\n", strerror(errno));
     exit(1);
   }
+  return mem;
+}
+
+static void *spare_thread(void *arg) {
+  // Only run on otherwise idle CPUs, never in place of the allocating thread
+  struct sched_param param = {0};
+  pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+  pthread_mutex_lock(&spare_lock);
+  for (;;) {
+    while (spare_from == NULL) {
+      pthread_cond_wait(&spare_wanted, &spare_lock);
+    }
+    char *from = spare_from;
+    spare_from = NULL;
+    pthread_mutex_unlock(&spare_lock);
+#ifdef MADV_POPULATE_WRITE
+    madvise(from, kSpareFaultSize, MADV_POPULATE_WRITE);
+#endif
+    pthread_mutex_lock(&spare_lock);
+  }
+  return NULL;
+}
+
+static void start_spare_thread() {
+#ifdef MADV_POPULATE_WRITE
+  const char *env = getenv("MYMALLOC_SPARE_CHUNK");
+  // The heap a spare is for, on a single node
+  if (env == NULL || atoi(env) == 0 || node_count > 1) {
+    return;
+  }
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, spare_thread, NULL) != 0) {
+    return;
+  }
+  pthread_detach(thread);
+  spare_enabled = 1;
+#endif
+}
 
-  // Set up the linked list
-  free_list_head->next = free_list_tail;
-  free_list_tail->prev = free_list_head;
+/* Wakes the spare thread to fault in the start of the next kMemorySize bytes
+   the locked heap grows by. */
+static void want_spare(struct NodeHeap *heap) {
+  char *from = (char *) ((uintptr_t) heap->chunk.fencepost_end & ~(kPageSize - 1));
+  if (from + kSpareFaultSize > heap->committed) {
+    return;
+  }
+  pthread_mutex_lock(&spare_lock);
+  spare_from = from;
+  pthread_cond_signal(&spare_wanted);
+  pthread_mutex_unlock(&spare_lock);
 }
 
 int get_chunk_size(size_t alloc_size) {
@@ -59,64 +518,124 @@ int get_chunk_size(size_t alloc_size) {
 }
 
 
-struct ChunkInfo request_memory(int n) {
-  is_requested_memory = 1;
-  struct ChunkInfo c;
-  Block *fencepost_start = NULL, *fencepost_end = NULL;
-  Block *free_list_start = NULL;
-  Linker *linker = NULL;
-  size_t request_mem_size = n * kMemorySize;
-  Block *head = mmap(NULL, request_mem_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
-  if (head == MAP_FAILED) {
-    fprintf(stderr, "mmap failed with error: %s\n", strerror(errno));
-    exit(1);
+/* Returns how many bytes to grow a heap by for an allocation of
+   `alloc_size` bytes. Growth starts at kInitialChunkSize and doubles every
+   time, so small programs stay small and growing ones quickly grow by
+   kMemorySize. A larger allocation grows the heap by its own size. */
+static size_t next_chunk_bytes(struct NodeHeap *heap, size_t alloc_size) {
+  size_t size = heap->next_chunk_size;
+  while (size - 2 * kLinkMetadataSize < alloc_size && size < kMemorySize) {
+    size *= 2;
+  }
+  if (size - 2 * kLinkMetadataSize < alloc_size) {
+    size = get_chunk_size(alloc_size) * kMemorySize;
+    if (size > kMaxBlockSize) {
+      size = round_up(alloc_size + 2 * kLinkMetadataSize, kPageSize);
+    }
+  }
+  heap->next_chunk_size = size < kMemorySize ? 2 * size : kMemorySize;
+  return size;
+}
+
+/* Makes the top of the locked heap's chunk from `block` on its
+   wilderness. */
+static void set_wilderness(struct NodeHeap *heap, Block *block) {
+  heap->wilderness = block;
+  if (block != heap->chunk.fencepost_end) {
+    // Free, so the chunk can be walked, but on no free list
+    block->size = 0;
+    set_block_size(block, (char *) heap->chunk.fencepost_end - (char *) block);
   }
-  fencepost_start = head;
-  // fencepost_start->allocated = 1;
-  // fencepost_start->size = kMetadataSize;
-  set_block_size(fencepost_start, kMetadataSize);
-  set_allocated(fencepost_start, 1);
-
-  free_list_start = ADD_BYTES(fencepost_start, kMetadataSize);
-  // free_list_start->allocated = 0;
-  // free_list_start->size = n * kAvailableSize;
-  set_block_size(free_list_start, n * kAvailableSize);
-  set_allocated(free_list_start, 0);
-  kHeapSize += n * kMemorySize;
-  linker = get_linker(free_list_start);
-  linker->next = NULL;
-  linker->prev = NULL;
-
-  // fencepost_end = ADD_BYTES(free_list_start, free_list_start->size);
-  fencepost_end = ADD_BYTES(free_list_start, block_size(free_list_start));
-  // fencepost_end->size = kMetadataSize;
-  // fencepost_end->allocated = 1;
+}
+
+/* Grows the chunk of the locked heap of `node` by `size` bytes, which join
+   its wilderness, or become it if the two together would be larger than a
+   block can be. */
+static void grow_chunk(struct NodeHeap *heap, int node, size_t size) {
+  struct ChunkInfo *c = &heap->chunk;
+  Block *old_end = c->fencepost_end;
+  Block *fencepost_end = ADD_BYTES(old_end, size);
+  commit_heap(heap, node, ADD_BYTES(fencepost_end, kMetadataSize));
+  is_requested_memory = 1;
   set_block_size(fencepost_end, kMetadataSize);
   set_allocated(fencepost_end, 1);
+  __atomic_store_n(&c->fencepost_end, fencepost_end, __ATOMIC_RELEASE);
+  Block *wilderness = heap->wilderness;
+  if ((size_t) ((char *) fencepost_end - (char *) wilderness) > kMaxBlockSize) {
+    // The old wilderness stays behind as a free block
+    Block *footer = get_footer(wilderness, block_size(wilderness));
+    set_block_size(footer, block_size(wilderness));
+    set_allocated(footer, 0);
+    insert_free_list(wilderness);
+    wilderness = old_end;
+  }
+  // The old end fencepost becomes the header of an empty wilderness
+  set_wilderness(heap, wilderness);
+  __atomic_add_fetch(&kHeapSize, size, __ATOMIC_RELAXED);
+  MY_TRACE(MY_TRACE_CHUNK_MAP, old_end, size, node);
+  if (spare_enabled && heap->next_chunk_size == kMemorySize) {
+    want_spare(heap);
+  }
+}
 
+/* Grows the locked heap of `node` for an allocation of `alloc_size`
+   bytes. */
+static void add_chunk(struct NodeHeap *heap, int node, size_t alloc_size) {
+  grow_chunk(heap, node, next_chunk_bytes(heap, alloc_size));
+}
 
-  c.fencepost_start = fencepost_start;
-  c.fencepost_end = fencepost_end;
-  c.block_start = free_list_start;
+/* Cuts a free block of `size` bytes off the bottom of the locked heap's
+   wilderness, growing the chunk first if it is too small, and returns it.
+   The block takes the whole wilderness if what would be left is too small
+   for a block. */
+static Block *take_wilderness(struct NodeHeap *heap, int node, size_t size) {
+  if ((size_t) ((char *) heap->chunk.fencepost_end - (char *) heap->wilderness) < size) {
+    add_chunk(heap, node, size);
+  }
+  Block *block = heap->wilderness;
+  size_t rest = (char *) heap->chunk.fencepost_end - (char *) block - size;
+  if (rest < kMinBlockSize) {
+    size += rest;
+  }
+  set_wilderness(heap, ADD_BYTES(block, size));
+  block->size = 0;
+  set_block_size(block, size);
+  return block;
+}
+
+struct ChunkInfo request_memory(int n) {
+  pthread_once(&heaps_once, initialize);
+  struct NodeHeap *heap = &node_heaps[0];
+  lock_heap(heap);
+  grow_chunk(heap, 0, n * kMemorySize);
+  struct ChunkInfo c = heap->chunk;
+  unlock_heap(heap);
   return c;
 }
 
 struct ChunkInfo get_cur_chunk(Block *block) {
-  for (int i = 0; i < chunk_idx; i++) {
-    Block *cur_fencepost_start = chunk_arr[i].fencepost_start;
-    Block *cur_fencepost_end = chunk_arr[i].fencepost_end;
-
-    // Check if the block is within the allocated range of the current chunk
-    if (block >= ADD_BYTES(cur_fencepost_start, kMetadataSize)  && block < cur_fencepost_end) {
-      return chunk_arr[i];
-    }
+  struct NodeHeap *heap = heap_of(block);
+  if (heap != NULL) {
+    struct ChunkInfo c = heap->chunk;
+    c.fencepost_end = __atomic_load_n(&heap->chunk.fencepost_end, __ATOMIC_ACQUIRE);
+    return c;
   }
   struct ChunkInfo invalid_chunk = {NULL, NULL, NULL};
   return invalid_chunk;
 }
 
 Block *find_free_block(size_t size) {
-  Linker *start = free_list_head->next;
+  size = round_up(size, kAlignment);
+  int list = size <= MAX_CLASS_SIZE ? kSizeClass[size / kAlignment] : N_SIZE_CLASSES;
+  // Any block on the list of a class at least as large as the size's fits
+  unsigned long long lists = cur_heap->nonempty & (~0ull << list) & ((1ull << N_SIZE_CLASSES) - 1);
+  if (lists != 0) {
+    return ptr_to_block(next_link(&cur_heap->free_lists[__builtin_ctzll(lists)][0]));
+  }
+
+  // Best fit among the blocks larger than every class
+  Linker *free_list_tail = &cur_heap->free_lists[N_SIZE_CLASSES][1];
+  Linker *start = next_link(&cur_heap->free_lists[N_SIZE_CLASSES][0]);
   Linker *best = NULL;
   size_t best_fit = __SIZE_MAX__;
 
@@ -129,7 +648,7 @@ Block *find_free_block(size_t size) {
         best = start;
       }
     }
-    start = start->next;
+    start = next_link(start);
   }
   if (best == NULL) {
     return NULL;
@@ -139,12 +658,20 @@ Block *find_free_block(size_t size) {
 
 
 void insert_free_list(Block *block) {
+  if (ADD_BYTES(block, block_size(block)) == cur_heap->chunk.fencepost_end) {
+    // The top of the chunk goes back to the wilderness
+    set_wilderness(cur_heap, block);
+    return;
+  }
+  int list = free_list_of(block_size(block));
+  Linker *free_list_head = &cur_heap->free_lists[list][0];
   Linker *cur_linker = get_linker(block);
-  Linker *next = free_list_head->next;
-  free_list_head->next = cur_linker;
-  cur_linker->prev = free_list_head;
-  cur_linker->next = next;
-  next->prev = cur_linker;
+  Linker *next = next_link(free_list_head);
+  set_next_link(free_list_head, cur_linker);
+  set_prev_link(cur_linker, free_list_head);
+  set_next_link(cur_linker, next);
+  set_prev_link(next, cur_linker);
+  cur_heap->nonempty |= 1ull << list;
 }
 
 
@@ -156,10 +683,11 @@ Block *split_block(Block *block, size_t size) {
   // block->allocated = 0;
   set_block_size(block, remain_size);
   set_allocated(block, 0);
+  MY_TRACE(MY_TRACE_SPLIT, block, remain_size, size);
 
   Block *footer = get_footer((Block*)block, remain_size);
   
-  if (remain_size >= 2 * kMetadataSize + kMinAllocationSize + kLinkMetadataSize) {
+  if (remain_size >= kMinBlockSize) {
     insert_free_list(block);
     // footer->allocated = 0;
     // footer->size = remain_size;
@@ -195,22 +723,19 @@ void coalesce_adjacent_blocks(Block *free_block) {
   Block* prev_block = get_prev_block(free_block);
   Block* next_block = get_next_block(free_block);
   // munmap(free_block+kMetadataSize, free_block->size - 2 * kMetadataSize);
-  if ((prev_block == NULL && is_valid_block(free_block)) || (next_block == NULL && is_valid_block(free_block))) {
-    Block* footer = NULL;
-    footer = get_footer(free_block, block_size(free_block));
-    // footer->allocated = 0;
-    // footer->size = block_size(free_block);
-    set_allocated(footer, 0);
-    set_block_size(footer, block_size(free_block));
-    // free_block->allocated = 0;
-    // free_block->size = block_size(free_block);
-    set_allocated(free_block, 0);
-    set_block_size(free_block, block_size(free_block));
-    insert_free_list(free_block);
+  if (!is_valid_block(free_block)) {
     return;
   }
+  // At a chunk edge the neighbour there is still merges, and
+  // insert_free_list makes the result the wilderness if it reaches the top
 
-  if (prev_block && !is_free(prev_block) && next_block && !is_free(next_block)) {
+  // A neighbour the block would outgrow kMaxBlockSize with stays apart
+  int next_free = next_block && is_free(next_block) &&
+                  block_size(free_block) + block_size(next_block) <= kMaxBlockSize;
+  int prev_free = prev_block && is_free(prev_block) &&
+                  block_size(prev_block) + block_size(free_block) + (next_free ? block_size(next_block) : 0) <= kMaxBlockSize;
+
+  if (!prev_free && !next_free) {
     // free_block->allocated = 0;
     // free_block->size = block_size(free_block);
     set_allocated(free_block, 0);
@@ -222,12 +747,13 @@ void coalesce_adjacent_blocks(Block *free_block) {
     set_allocated(footer, 0);
     set_block_size(footer, block_size(free_block));
     
-  } else if (prev_block && is_free(prev_block) && next_block && is_free(next_block)) {
+  } else if (prev_free && next_free) {
     Block* new_head = NULL;
     size_t coalesce_size = block_size(prev_block) + block_size(free_block) + block_size(next_block);
     splice_out_block(prev_block);
     splice_out_block(next_block);
     new_head = prev_block;
+    MY_TRACE(MY_TRACE_COALESCE, new_head, coalesce_size, 3);
     // new_head->allocated = 0;
     // new_head->size = coalesce_size;
     set_allocated(new_head, 0);
@@ -239,11 +765,12 @@ void coalesce_adjacent_blocks(Block *free_block) {
     set_allocated(footer, 0);
     set_block_size(footer, coalesce_size);
 
-  } else if (next_block && is_free(next_block)) {
+  } else if (next_free) {
     Block* new_head = NULL;
     size_t coalesce_size = block_size(free_block) + block_size(next_block);
     splice_out_block(next_block);
     new_head = free_block;
+    MY_TRACE(MY_TRACE_COALESCE, new_head, coalesce_size, 2);
     // new_head->allocated = 0;
     // new_head->size = coalesce_size;
     set_allocated(new_head, 0);
@@ -254,11 +781,12 @@ void coalesce_adjacent_blocks(Block *free_block) {
     // footer->size = coalesce_size;
     set_allocated(footer, 0);
     set_block_size(footer, coalesce_size);
-  } else if (prev_block && is_free(prev_block)) {
+  } else if (prev_free) {
     Block* new_head = NULL;
     size_t coalesce_size = block_size(free_block) + block_size(prev_block);
     splice_out_block(prev_block);
     new_head = prev_block;
+    MY_TRACE(MY_TRACE_COALESCE, new_head, coalesce_size, 2);
     // new_head->allocated = 0;
     // new_head->size = coalesce_size;
     set_allocated(new_head, 0);
@@ -277,64 +805,145 @@ void coalesce_adjacent_blocks(Block *free_block) {
 void splice_out_block(Block* block) {
   Linker* prev = NULL;
   Linker* next = NULL;
+  // On no list, merged into a freed block that becomes it again
+  if (block == cur_heap->wilderness) {
+    return;
+  }
   Linker *cur_linker = get_linker(block);
-  if (cur_linker != free_list_head && cur_linker != free_list_tail) {
-    prev = cur_linker->prev;
-    next = cur_linker->next;
-    prev->next = next;
-    next->prev = prev;
+  prev = prev_link(cur_linker);
+  next = next_link(cur_linker);
+  if (prev == NULL || next == NULL) {
+    return;
+  }
+  set_next_link(prev, next);
+  set_prev_link(next, prev);
+  // Only the head and tail of a list have no outer neighbour
+  if (prev_link(prev) == NULL && next_link(next) == NULL) {
+    cur_heap->nonempty &= ~(1ull << free_list_of(block_size(block)));
   }
 }
 
 int is_valid_block(Block *block) {
-  for (int i = 0; i < chunk_idx; i++) {
-    Block *cur_fencepost_start = chunk_arr[i].fencepost_start;
-    Block *cur_fencepost_end = chunk_arr[i].fencepost_end;
+  return heap_of(block) != NULL;
+}
 
-    // Check if the block is within the allocated range of the current chunk
-    if (block >= ADD_BYTES(cur_fencepost_start, kMetadataSize) && block < cur_fencepost_end) {
-      return 1;  // Block is valid
-    }
+/* Gives the whole pages of a block of `size` bytes just freed, and merged
+   into a free block, back to the kernel. Its first bytes may hold the free
+   block's header and links, and the heap must be locked: a block split off
+   the free block once it is unlocked could be in the pages. */
+static void release_pages(Block *block, size_t size) {
+  uintptr_t from = round_up((uintptr_t) block + kMetadataSize + kLinkMetadataSize, kPageSize);
+  uintptr_t to = ((uintptr_t) block + size - kMetadataSize) & ~(kPageSize - 1);
+  if (from < to) {
+    madvise((void *) from, to - from, MADV_DONTNEED);
+  }
+}
+
+
+/* Records a new block in the event trace, and counts it towards the next
+   heap profile sample, marking it if it is the one sampled. */
+static inline void *record_malloc(void *ptr, size_t size) {
+  MY_TRACE(MY_TRACE_ALLOC, ptr, size, block_size(ptr_to_block(ptr)));
+  if (__builtin_expect((my_profile_countdown -= size) < 0, 0) && my_profile_malloc(ptr, size)) {
+    ptr_to_block(ptr)->size |= SAMPLED_MASK;
+  }
+  return ptr;
+}
+
+/** Huge blocks: an allocation of kHugeSize bytes or more gets a mapping of
+ *  its own instead of a chunk. my_free unmaps it, and my_realloc resizes it
+ *  with mremap(MREMAP_MAYMOVE), so a buffer that keeps growing costs page
+ *  table updates rather than a copy of its contents. The mapping starts
+ *  with kHugeHeaderSize bytes ending in the block's tag, which has a size of
+ *  0, and is registered with the page map as a span, so my_free recognises
+ *  a huge block without reading through a pointer that might not be ours.
+ **/
+const size_t kHugeSize = (1ull << 20);
+
+// Up to the tag, which keep the payload 16 byte aligned
+const size_t kHugeHeaderSize = 32;
+
+inline static void *huge_payload(Span *span) {
+  return ADD_BYTES(span->start, kHugeHeaderSize);
+}
+
+/* Returns the span of a huge block's payload, or NULL if the pointer isn't
+   the payload of a huge block. */
+static Span *huge_of(void *ptr) {
+  Span *span = my_span_of(ptr);
+  return span != NULL && span->kind == MY_SPAN_LARGE && huge_payload(span) == ptr ? span : NULL;
+}
+
+/* Maps a huge block, or returns NULL if the kernel won't. */
+static void *malloc_huge(size_t size) {
+  size_t map_size = round_up(kHugeHeaderSize + size, kPageSize);
+  void *mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    return NULL;
+  }
+  is_requested_memory = 1;
+  Span *span = my_span_register(mem, map_size, MY_SPAN_LARGE);
+  Block *tag = ptr_to_block(huge_payload(span));
+  tag->size = 0;
+  set_allocated(tag, 1);
+  return huge_payload(span);
+}
+
+/* Tells the profiler and the trace a huge block at `ptr` of `map_size`
+   bytes is gone, as my_free does for the others. */
+static void forget_huge(Block *tag, void *ptr, size_t map_size) {
+  if (tag->size & SAMPLED_MASK) {
+    my_profile_free(ptr);
+    tag->size &= ~SAMPLED_MASK;
   }
-  return 0;
+  MY_TRACE(MY_TRACE_FREE, ptr, map_size, 0);
 }
 
+static void free_huge(Span *span, void *ptr) {
+  forget_huge(ptr_to_block(ptr), ptr, span->pages * kPageSize);
+  void *mem = span->start;
+  size_t map_size = span->pages * kPageSize;
+  my_span_unregister(span);
+  munmap(mem, map_size);
+}
 
 void *my_malloc(size_t size) {
   if (size == 0 || size > kMaxAllocationSize) {
     return NULL;
   }
 
-  size_t min_allocation_size = round_up(kMetadataSize + kLinkMetadataSize + kMinAllocationSize + kMetadataSize, kAlignment);
+  size_t min_allocation_size = round_up(kMinBlockSize, kAlignment);
   size_t alloc_size = round_up(kMetadataSize + size + kMetadataSize, kAlignment);
   if (alloc_size < min_allocation_size) {
     alloc_size = min_allocation_size;
   }
+  alloc_size = class_size(alloc_size);
+#ifdef ENABLE_HISTOGRAM
+  record_size(size);
+#endif
   // size_t alloc_size = round_up(kMetadataSize + kLinkMetadataSize + size + kMetadataSize, kAlignment);
 
-  if (is_requested_memory == 0) {
-    initialize();
-    struct ChunkInfo chunk;
-    int chunk_size = get_chunk_size(alloc_size);
-    chunk = request_memory(chunk_size);
-    chunk_arr[chunk_idx++] = chunk;
-    insert_free_list(chunk.block_start);
+  pthread_once(&heaps_once, initialize);
+  if (size >= kHugeSize) {
+    void *ptr = malloc_huge(size);
+    return ptr != NULL ? record_malloc(ptr, size) : NULL;
+  }
+  if (placement_flags != 0 && size <= kPlacementMaxSize) {
+    return my_malloc_flags(size, placement_flags);
   }
+  int node = current_node();
+  struct NodeHeap *heap = &node_heaps[node];
+  lock_heap(heap);
 
   Block *free_block = find_free_block(alloc_size);
-  if (free_block == NULL) {
-    // return NULL;
-    // No suitable free block, request more memory from the kernel
-    struct ChunkInfo new_chunk;
-    int chunk_size = get_chunk_size(alloc_size);
-    new_chunk = request_memory(chunk_size);
-    chunk_arr[chunk_idx++] = new_chunk;
-    insert_free_list(new_chunk.block_start);
-    free_block = find_free_block(alloc_size);
-  } 
+  if (free_block != NULL) {
+    // remove_from_free_list(free_block);
+    splice_out_block(free_block);
+  } else {
+    // No suitable free block, carve one off the wilderness
+    free_block = take_wilderness(heap, node, alloc_size);
+  }
   cur_free_block = free_block;
-  // remove_from_free_list(free_block);
-  splice_out_block(free_block);
   
   if (block_size(free_block) <= (alloc_size + kMetadataSize + kMinAllocationSize)){
     // remove_from_free_list(free_block);
@@ -352,15 +961,81 @@ void *my_malloc(size_t size) {
     set_allocated(footer, 1);
     set_block_size(footer, block_size(free_block));
     // footer->size = block_size(free_block);
-    return payload_ptr;
+    unlock_heap(heap);
+    return record_malloc(payload_ptr, size);
   }
 
   Block *payload = split_block(free_block, alloc_size);
-  
-  return payload;
+  unlock_heap(heap);
+  return record_malloc(payload, size);
 }
 
 
+/* malloc_placed off the bottom of the wilderness: at the first boundary
+   that leaves either nothing below it or a free block, and padded so the
+   next placed block's payload can start on the boundary after it. */
+static void *malloc_placed_wilderness(struct NodeHeap *heap, int node, size_t size, size_t alignment) {
+  // Grown first, as growing may start a new wilderness (see grow_chunk)
+  size_t most = round_up(size, alignment) + 2 * alignment + 2 * kMinBlockSize;
+  if ((size_t) ((char *) heap->chunk.fencepost_end - (char *) heap->wilderness) < most) {
+    add_chunk(heap, node, most);
+  }
+  uintptr_t start = (uintptr_t) heap->wilderness;
+  uintptr_t payload = round_up(start + kMetadataSize, alignment);
+  if (payload - kMetadataSize != start && payload - kMetadataSize - start < kMinBlockSize) {
+    payload += alignment;
+  }
+  size_t lead = payload - kMetadataSize - start;
+  uintptr_t end = round_up(payload + round_up(size, alignment) + 2 * kMetadataSize, alignment) - kMetadataSize;
+  Block *block = take_wilderness(heap, node, end - start);
+  cur_free_block = block;
+  if (lead > 0) {
+    return split_block(block, block_size(block) - lead);
+  }
+  set_allocated(block, 1);
+  Block *footer = get_footer(block, block_size(block));
+  set_block_size(footer, block_size(block));
+  set_allocated(footer, 1);
+  return ADD_BYTES(block, kMetadataSize);
+}
+
+/* Allocates a block from the locked heap whose payload starts on an
+   `alignment` boundary and is padded to a multiple of it. */
+static void *malloc_placed(struct NodeHeap *heap, int node, size_t size, size_t alignment) {
+  size_t placed_size = round_up(size, alignment) + 2 * kMetadataSize;
+  // Room to slide the block down to the boundary and leave a free block
+  // below it
+  size_t search_size = placed_size + alignment + kMinBlockSize;
+  Block *free_block = find_free_block(search_size);
+  if (free_block == NULL) {
+    return malloc_placed_wilderness(heap, node, size, alignment);
+  }
+  cur_free_block = free_block;
+  splice_out_block(free_block);
+  uintptr_t end = (uintptr_t) free_block + block_size(free_block);
+  uintptr_t payload = (end - placed_size + kMetadataSize) & ~(alignment - 1);
+  // The block runs to the end of the free block, past the padding
+  return split_block(free_block, end - payload + kMetadataSize);
+}
+
+void *my_malloc_flags(size_t size, int flags) {
+  size_t alignment = flags & MY_MALLOC_PAGE ? kPageSize : flags & MY_MALLOC_CACHE_LINE ? kCacheLineSize : 0;
+  if (alignment == 0) {
+    return my_malloc(size);
+  }
+  // The block holds the padding and may take a lead fragment with it
+  if (size == 0 || size > kMaxAllocationSize || size > kMaxBlockSize - 4 * alignment - 2 * kMinBlockSize) {
+    return NULL;
+  }
+  pthread_once(&heaps_once, initialize);
+  int node = current_node();
+  struct NodeHeap *heap = &node_heaps[node];
+  lock_heap(heap);
+  void *payload = malloc_placed(heap, node, size, alignment);
+  unlock_heap(heap);
+  return record_malloc(payload, size);
+}
+
 void my_free(void *ptr) {
   if (ptr == NULL) {
     return;
@@ -374,15 +1049,176 @@ void my_free(void *ptr) {
     return;
   }
 
-  if (!is_valid_block(block)) {
+  Span *span = my_span_of(ptr);
+  if (span != NULL && span->kind == MY_SPAN_SLAB) {
+    my_slab_free(span, ptr);
+    return;
+  }
+  if (span != NULL && span->kind == MY_SPAN_LARGE) {
+    if (huge_payload(span) == ptr) {
+      free_huge(span, ptr);
+    }
+    return;
+  }
+  struct NodeHeap *heap = heap_of(block);
+  if (heap == NULL) {
     return;
   }
   
   // block->allocated = 0;  // Mark the block as free
   // insert_free_list((FreeBlock*)block);
 
+  if (block->size & SAMPLED_MASK) {
+    my_profile_free(ptr);
+  }
+  MY_TRACE(MY_TRACE_FREE, ptr, block_size(block), 0);
+
   // Coalesce the block with its neighbors if possible
+  size_t size = block_size(block);
+  lock_heap(heap);
   coalesce_adjacent_blocks(block);
+  if (size >= kReleaseSize) {
+    release_pages(block, size);
+  }
+  unlock_heap(heap);
+}
+
+/* my_free for a block returned by my_malloc(size). The caller vouches for
+   the pointer, so the neighbours are found through the boundary tags alone:
+   the fenceposts are allocated, which stops coalescing at the chunk edges.
+   Falls back to my_free if `size` doesn't fit the block. */
+void my_free_sized(void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return;
+  }
+
+  Block *block = ptr_to_block(ptr);
+  if (size <= MY_CACHE_MAX_SIZE && is_requested_memory) {
+    // Slab blocks have no header
+    Span *span = my_span_of(ptr);
+    if (span != NULL && span->kind == MY_SPAN_SLAB) {
+      my_slab_free(span, ptr);
+      return;
+    }
+  }
+  struct NodeHeap *heap = is_requested_memory ? heap_of(block) : NULL;
+  if (heap == NULL || is_free(block) ||
+      block_size(block) < round_up(kMetadataSize + size + kMetadataSize, kAlignment)) {
+    my_free(ptr);
+    return;
+  }
+  if (block->size & SAMPLED_MASK) {
+    my_profile_free(ptr);
+  }
+  MY_TRACE(MY_TRACE_FREE, ptr, block_size(block), 0);
+
+  lock_heap(heap);
+  Block *freed = block;
+  size_t size_free = block_size(block);
+  size_t freed_size = size_free;
+  int merged = 1;
+  Block *next_block = ADD_BYTES(block, size_free);
+  // Neighbours the block would outgrow kMaxBlockSize with stay apart
+  if (is_free(next_block) && size_free + block_size(next_block) <= kMaxBlockSize) {
+    splice_out_block(next_block);
+    size_free += block_size(next_block);
+    merged++;
+  }
+  Block *prev_footer = ADD_BYTES(block, -((size_t) kMetadataSize));
+  if (is_free(prev_footer) && size_free + block_size(prev_footer) <= kMaxBlockSize) {
+    block = ADD_BYTES(block, -((size_t) block_size(prev_footer)));
+    splice_out_block(block);
+    size_free += block_size(block);
+    merged++;
+  }
+  if (merged > 1) {
+    MY_TRACE(MY_TRACE_COALESCE, block, size_free, merged);
+  }
+
+  set_allocated(block, 0);
+  set_block_size(block, size_free);
+  Block *footer = get_footer(block, size_free);
+  set_allocated(footer, 0);
+  set_block_size(footer, size_free);
+  insert_free_list(block);
+  if (freed_size >= kReleaseSize) {
+    release_pages(freed, freed_size);
+  }
+  unlock_heap(heap);
+}
+
+/* Moves a block of `capacity` bytes of payload to a new block of `size`
+   bytes. */
+static void *move_block(void *ptr, size_t capacity, size_t size) {
+  void *new_ptr = my_malloc(size);
+  if (new_ptr == NULL) {
+    return NULL;
+  }
+  my_copy(new_ptr, ptr, capacity < size ? capacity : size);
+  my_free(ptr);
+  return new_ptr;
+}
+
+void *my_calloc(size_t count, size_t size) {
+  size_t bytes;
+  if (__builtin_mul_overflow(count, size, &bytes)) {
+    return NULL;
+  }
+  void *ptr = my_malloc(bytes);
+  // Huge blocks are fresh mappings, already zero
+  if (ptr != NULL && bytes < kHugeSize) {
+    my_zero(ptr, bytes);
+  }
+  return ptr;
+}
+
+void *my_realloc(void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return my_malloc(size);
+  }
+  if (size == 0) {
+    my_free(ptr);
+    return NULL;
+  }
+  if (!is_requested_memory) {
+    return realloc(ptr, size);
+  }
+  if (size > kMaxAllocationSize) {
+    return NULL;
+  }
+
+  Span *span = my_span_of(ptr);
+  if (span != NULL && span->kind == MY_SPAN_SLAB) {
+    size_t capacity = (size_t) span->slab.size_class * MY_CACHE_QUANTUM;
+    return size <= capacity ? ptr : move_block(ptr, capacity, size);
+  }
+  Block *block = ptr_to_block(ptr);
+  if (is_valid_block(block)) {
+    // Shrinks in place, only the copy is saved when growing
+    size_t capacity = block_size(block) - 2 * kMetadataSize;
+    return size <= capacity ? ptr : move_block(ptr, capacity, size);
+  }
+  span = huge_of(ptr);
+  if (span == NULL) {
+    return NULL;
+  }
+  size_t old_size = span->pages * kPageSize;
+  size_t map_size = round_up(kHugeHeaderSize + size, kPageSize);
+  if (size < kHugeSize) {
+    return move_block(ptr, old_size - kHugeHeaderSize, size);
+  }
+  if (map_size == old_size) {
+    return ptr;
+  }
+  void *moved = mremap(span->start, old_size, map_size, MREMAP_MAYMOVE);
+  if (moved == MAP_FAILED) {
+    return NULL;
+  }
+  // Traced and profiled as a free and a new block, the address may change
+  forget_huge(ptr_to_block(ADD_BYTES(moved, kHugeHeaderSize)), ptr, old_size);
+  my_span_unregister(span);
+  span = my_span_register(moved, map_size, MY_SPAN_LARGE);
+  return record_malloc(huge_payload(span), size);
 }
 
 /** These are helper functions you are required to implement for internal testing
@@ -2,17 +2,17 @@
 #define MYMALLOC_HEADER
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
 #include <sys/mman.h>
+#include "mycache.h"
 
-#ifdef ENABLE_LOG
-#define LOG(...) fprintf(stderr, "[malloc] " __VA_ARGS__);
-#else
-#define LOG(...)
+#ifdef __cplusplus
+extern "C" {
 #endif
 
 #define N_LISTS 59
@@ -20,7 +20,9 @@
 #define ADD_BYTES(ptr, n) ((void *) (((char *) (ptr)) + (n)))
 
 #define ALLOCATED_MASK ((size_t)1)
-#define SIZE_MASK (~ALLOCATED_MASK)
+// Set on allocated blocks sampled by the heap profiler (myprofile.h)
+#define SAMPLED_MASK ((size_t)2)
+#define SIZE_MASK (~(ALLOCATED_MASK | SAMPLED_MASK))
 
 /** This is the Block struct, which contains all metadata needed for your 
  *  explicit free list. You are allowed to modify this struct (and will need to 
@@ -40,6 +42,22 @@ typedef struct Linker Linker;
 //   bool allocated;
 // };
 
+#ifdef COMPACT_HEADERS
+/** Compact format (make COMPACT=1): 4 byte boundary tags, and free list links
+ *  that are 32 bit offsets in words from the start of the region the heap is
+ *  reserved in (0 for none). A free block needs 16 bytes instead of 40.
+ *  Blocks start 4 bytes short of a word boundary, so payloads stay word
+ *  aligned.
+ **/
+struct Block {
+    uint32_t size;
+};
+
+struct Linker {
+    uint32_t prev;
+    uint32_t next;
+};
+#else
 struct Block {
     size_t size;
     // bool allocated;
@@ -49,6 +67,7 @@ struct Linker {
     Linker *prev;
     Linker *next;
 };
+#endif
 
 // struct FreeBlock {
 //     size_t size;
@@ -66,6 +85,8 @@ struct ChunkInfo {
     Block* fencepost_start;
     Block* fencepost_end;
     Block* block_start;
+    // NUMA node the chunk is bound to
+    int node;
 };
 
 
@@ -75,7 +96,7 @@ extern const size_t kAlignment;
 extern const size_t kMinAllocationSize;
 // Size of meta-data per Block
 extern const size_t kMetadataSize;
-// Maximum allocation size (128 MB)
+// Maximum allocation size (4 GB)
 extern const size_t kMaxAllocationSize;
 // Memory size that is mmapped (64 MB)
 extern const size_t kMemorySize;
@@ -101,6 +122,26 @@ void coalesce_adjacent_blocks(Block *free_block);
 int is_valid_block(Block *block);
 void *my_malloc(size_t size);
 void my_free(void *p);
+/* my_free for a pointer returned by my_malloc(size), which lets the
+   allocator skip validating it. */
+void my_free_sized(void *p, size_t size);
+/* Resizes a block, keeping its contents up to the smaller size. A block of
+   1 MB or more has a mapping of its own, which is resized with mremap
+   rather than copied. */
+void *my_realloc(void *p, size_t size);
+/* my_malloc of `count * size` bytes, zeroed; NULL if the product
+   overflows. */
+void *my_calloc(size_t count, size_t size);
+
+/* Placement flags of my_malloc_flags. */
+// The payload gets cache lines of its own, so blocks written by different
+// threads never share a line
+#define MY_MALLOC_CACHE_LINE 1
+// The payload gets pages of its own
+#define MY_MALLOC_PAGE 2
+/* my_malloc with placement flags. MYMALLOC_PLACEMENT=line (or page) in the
+   environment applies them to every my_malloc of up to a page. */
+void *my_malloc_flags(size_t size, int flags);
 
 /* Helper functions you are required to implement for internal testing. */
 void set_allocated(Block* block, int allocated);
@@ -115,4 +156,61 @@ Block *ptr_to_block(void *ptr);
 Linker *get_linker(Block* block);
 Block *get_footer(void* ptr, size_t alloc_size);
 
+/** Inline fast path for small sizes: with a size of up to MY_CACHE_MAX_SIZE
+ *  bytes, my_malloc_inline pops a block off the calling thread's free list
+ *  for the size's class (see mycache.h) and my_free_inline pushes it back;
+ *  neither makes a call unless the list is empty or full. With a size known
+ *  at compile time (and optimisation on) the class and the size check
+ *  resolve at compile time. Other sizes go to my_malloc and my_free_sized.
+ *  A block from my_malloc_inline(size) may be freed with my_free, but
+ *  my_free_inline only takes blocks from my_malloc_inline with a size of
+ *  the same class.
+ *
+ *  With NO_THREAD_CACHE defined (make MALLOC=mygc, and by mygc.h) there is
+ *  no cache and both go straight to my_malloc and my_free_sized: the
+ *  collector doesn't scan the caches, so it would take a cached block for
+ *  garbage and hand it out again.
+ **/
+__attribute__((always_inline)) static inline void *my_malloc_inline(size_t size) {
+#ifndef NO_THREAD_CACHE
+    if (size > 0 && size <= MY_CACHE_MAX_SIZE) {
+        const int size_class = MY_CACHE_CLASS(size);
+        void *block = my_thread_cache.lists[size_class];
+        if (__builtin_expect(block != NULL, 1)) {
+            my_thread_cache.lists[size_class] = *(void **) block;
+            my_thread_cache.counts[size_class]--;
+            return block;
+        }
+        return my_cache_refill(size_class);
+    }
+#endif
+    return my_malloc(size);
+}
+
+__attribute__((always_inline)) static inline void my_free_inline(void *ptr, size_t size) {
+#ifndef NO_THREAD_CACHE
+    if (size > 0 && size <= MY_CACHE_MAX_SIZE) {
+        const int size_class = MY_CACHE_CLASS(size);
+        if (ptr == NULL) {
+            return;
+        }
+        *(void **) ptr = my_thread_cache.lists[size_class];
+        my_thread_cache.lists[size_class] = ptr;
+        if (__builtin_expect(++my_thread_cache.counts[size_class] > MY_CACHE_LIMIT, 0)) {
+            my_cache_flush(size_class);
+        }
+        return;
+    }
+#endif
+    my_free_sized(ptr, size);
+}
+
+// Allocates and frees an object of type T
+#define my_new(T) ((T *) my_malloc_inline(sizeof(T)))
+#define my_delete(ptr) my_free_inline((ptr), sizeof(*(ptr)))
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,235 @@
+#ifndef MYMALLOC_HPP_HEADER
+#define MYMALLOC_HPP_HEADER
+
+#include "mymalloc.h"
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <new>
+
+/** C++ adapters over my_malloc (header-only, C++17):
+ *  - mymalloc::MemoryResource, a std::pmr::memory_resource, with a shared
+ *    instance from mymalloc::memory_resource();
+ *  - mymalloc::Allocator<T>, an allocator for the standard containers;
+ *  - replacements for the global operator new and delete, defined in the one
+ *    translation unit that includes this header with MYMALLOC_REPLACE_NEW.
+ *  Sized deallocation goes to my_free_sized. my_malloc only aligns to one
+ *  word, so a stricter alignment over-allocates and keeps the pointer to the
+ *  block in the word below the aligned address.
+ **/
+
+namespace mymalloc {
+
+// Alignment of every block from my_malloc (kAlignment)
+constexpr std::size_t kBaseAlignment = sizeof(std::size_t);
+
+/* Bytes to request from my_malloc for `size` bytes aligned to `alignment`,
+   or 0 if that overflows. */
+inline std::size_t padded_size(std::size_t size, std::size_t alignment) noexcept {
+  if (alignment <= kBaseAlignment) {
+    return size;
+  }
+  if (size > std::numeric_limits<std::size_t>::max() - alignment - sizeof(void *)) {
+    return 0;
+  }
+  return size + alignment + sizeof(void *);
+}
+
+/* Returns `size` bytes aligned to `alignment` (a power of two), or nullptr. */
+inline void *allocate(std::size_t size, std::size_t alignment = kBaseAlignment) noexcept {
+  // my_malloc(0) returns NULL, but new must return a unique pointer
+  if (size == 0) {
+    size = 1;
+  }
+  std::size_t padded = padded_size(size, alignment);
+  if (padded == 0) {
+    return nullptr;
+  }
+  void *block = my_malloc(padded);
+  if (block == nullptr || alignment <= kBaseAlignment) {
+    return block;
+  }
+  std::uintptr_t p = (reinterpret_cast<std::uintptr_t>(block) + sizeof(void *) + alignment - 1) & ~(std::uintptr_t) (alignment - 1);
+  reinterpret_cast<void **>(p)[-1] = block;
+  return reinterpret_cast<void *>(p);
+}
+
+/* Frees memory from allocate(size, alignment). */
+inline void deallocate(void *p, std::size_t size, std::size_t alignment = kBaseAlignment) noexcept {
+  if (p == nullptr) {
+    return;
+  }
+  if (size == 0) {
+    size = 1;
+  }
+  if (alignment <= kBaseAlignment) {
+    my_free_sized(p, size);
+  } else {
+    my_free_sized(static_cast<void **>(p)[-1], padded_size(size, alignment));
+  }
+}
+
+/* Frees memory from allocate(size, alignment) when the size isn't known. */
+inline void deallocate_unsized(void *p, std::size_t alignment = kBaseAlignment) noexcept {
+  if (p == nullptr) {
+    return;
+  }
+  my_free(alignment <= kBaseAlignment ? p : static_cast<void **>(p)[-1]);
+}
+
+class MemoryResource : public std::pmr::memory_resource {
+ protected:
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+    void *p = mymalloc::allocate(bytes, alignment);
+    if (p == nullptr) {
+      throw std::bad_alloc();
+    }
+    return p;
+  }
+
+  void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override {
+    mymalloc::deallocate(p, bytes, alignment);
+  }
+
+  // All instances share the one heap
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+    return dynamic_cast<const MemoryResource *>(&other) != nullptr;
+  }
+};
+
+inline MemoryResource *memory_resource() noexcept {
+  static MemoryResource resource;
+  return &resource;
+}
+
+template <typename T>
+class Allocator {
+ public:
+  using value_type = T;
+
+  Allocator() noexcept = default;
+  template <typename U>
+  Allocator(const Allocator<U> &) noexcept {}
+
+  T *allocate(std::size_t n) {
+    if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+      throw std::bad_array_new_length();
+    }
+    void *p = mymalloc::allocate(n * sizeof(T), alignof(T));
+    if (p == nullptr) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T *>(p);
+  }
+
+  void deallocate(T *p, std::size_t n) noexcept {
+    mymalloc::deallocate(p, n * sizeof(T), alignof(T));
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const Allocator<T> &, const Allocator<U> &) noexcept {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const Allocator<T> &, const Allocator<U> &) noexcept {
+  return false;
+}
+
+}  // namespace mymalloc
+
+#ifdef MYMALLOC_REPLACE_NEW
+
+void *operator new(std::size_t size) {
+  void *p = mymalloc::allocate(size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  void *p = mymalloc::allocate(size, static_cast<std::size_t>(alignment));
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+  return operator new(size, alignment);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return mymalloc::allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return mymalloc::allocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+  return mymalloc::allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+  return mymalloc::allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *p) noexcept {
+  mymalloc::deallocate_unsized(p);
+}
+
+void operator delete[](void *p) noexcept {
+  mymalloc::deallocate_unsized(p);
+}
+
+void operator delete(void *p, std::size_t size) noexcept {
+  mymalloc::deallocate(p, size);
+}
+
+void operator delete[](void *p, std::size_t size) noexcept {
+  mymalloc::deallocate(p, size);
+}
+
+void operator delete(void *p, std::align_val_t alignment) noexcept {
+  mymalloc::deallocate_unsized(p, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void *p, std::align_val_t alignment) noexcept {
+  mymalloc::deallocate_unsized(p, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *p, std::size_t size, std::align_val_t alignment) noexcept {
+  mymalloc::deallocate(p, size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void *p, std::size_t size, std::align_val_t alignment) noexcept {
+  mymalloc::deallocate(p, size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  mymalloc::deallocate_unsized(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  mymalloc::deallocate_unsized(p);
+}
+
+void operator delete(void *p, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+  mymalloc::deallocate_unsized(p, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void *p, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+  mymalloc::deallocate_unsized(p, static_cast<std::size_t>(alignment));
+}
+
+#endif
+
+#endif
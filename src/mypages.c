@@ -0,0 +1,216 @@
+#include "mypages.h"
+#include <pthread.h>
+
+Span **my_page_map[MY_PAGE_MAP_LEAF];
+
+// Free spans of 1 to MAX_LIST_PAGES pages by size, and the larger ones at 0
+#define MAX_LIST_PAGES 128
+// Memory the page heap maps at least at a time, in pages
+#define GROW_PAGES 256
+// Span descriptors mapped at a time
+#define DESCRIPTOR_BATCH 1024
+
+static Span *free_spans[MAX_LIST_PAGES + 1];
+// Unused descriptors, linked through next
+static Span *spare_descriptors = NULL;
+static struct MyPageStats stats;
+static pthread_mutex_t pages_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *map_anonymous(size_t size) {
+  void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    fprintf(stderr, "mmap failed with error: %s\n", strerror(errno));
+    exit(1);
+  }
+  return mem;
+}
+
+static void *(*map_pages)(size_t size) = map_anonymous;
+
+void my_pages_init(void *(*map)(size_t size)) {
+  map_pages = map;
+}
+
+static Span *new_descriptor(void) {
+  if (spare_descriptors == NULL) {
+    Span *batch = map_anonymous(DESCRIPTOR_BATCH * sizeof(Span));
+    for (int i = 0; i < DESCRIPTOR_BATCH; i++) {
+      batch[i].next = spare_descriptors;
+      spare_descriptors = &batch[i];
+    }
+  }
+  Span *span = spare_descriptors;
+  spare_descriptors = span->next;
+  memset(span, 0, sizeof(*span));
+  return span;
+}
+
+static void delete_descriptor(Span *span) {
+  span->next = spare_descriptors;
+  spare_descriptors = span;
+}
+
+/* Points the page map entry of the page at `addr` to `span`. */
+static void set_page(const char *addr, Span *span) {
+  uintptr_t page = (uintptr_t) addr >> MY_PAGE_SHIFT;
+  Span **leaf = my_page_map[page >> MY_PAGE_MAP_BITS];
+  if (leaf == NULL) {
+    leaf = map_anonymous(MY_PAGE_MAP_LEAF * sizeof(Span *));
+    __atomic_store_n(&my_page_map[page >> MY_PAGE_MAP_BITS], leaf, __ATOMIC_RELEASE);
+  }
+  __atomic_store_n(&leaf[page & (MY_PAGE_MAP_LEAF - 1)], span, __ATOMIC_RELEASE);
+}
+
+static void set_pages(Span *span, Span *value) {
+  for (size_t i = 0; i < span->pages; i++) {
+    set_page(span->start + (i << MY_PAGE_SHIFT), value);
+  }
+}
+
+inline static char *span_end(Span *span) {
+  return span->start + (span->pages << MY_PAGE_SHIFT);
+}
+
+inline static int list_of(size_t pages) {
+  return pages <= MAX_LIST_PAGES ? (int) pages : 0;
+}
+
+static void remove_free(Span *span) {
+  if (span->prev != NULL) {
+    span->prev->next = span->next;
+  } else {
+    free_spans[list_of(span->pages)] = span->next;
+  }
+  if (span->next != NULL) {
+    span->next->prev = span->prev;
+  }
+}
+
+static void push_free(Span *span) {
+  int list = list_of(span->pages);
+  span->kind = MY_SPAN_FREE;
+  span->prev = NULL;
+  span->next = free_spans[list];
+  if (span->next != NULL) {
+    span->next->prev = span;
+  }
+  free_spans[list] = span;
+  set_page(span->start, span);
+  set_page(span_end(span) - MY_PAGE_SIZE, span);
+}
+
+/* Makes a span free, merged with its free neighbours. Its pages must not be
+   in the page map. */
+static void insert_free(Span *span) {
+  Span *left = my_span_of(span->start - MY_PAGE_SIZE);
+  if (left != NULL && left->kind == MY_SPAN_FREE) {
+    remove_free(left);
+    set_page(left->start - MY_PAGE_SIZE + (left->pages << MY_PAGE_SHIFT), NULL);
+    span->start = left->start;
+    span->pages += left->pages;
+    delete_descriptor(left);
+  }
+  Span *right = my_span_of(span_end(span));
+  if (right != NULL && right->kind == MY_SPAN_FREE) {
+    remove_free(right);
+    set_page(right->start, NULL);
+    span->pages += right->pages;
+    delete_descriptor(right);
+  }
+  push_free(span);
+}
+
+/* Returns a free span of at least `pages` pages, or NULL: the first of the
+   smallest list that has one, best fit among the large ones. */
+static Span *find_free(size_t pages) {
+  for (size_t list = pages; list <= MAX_LIST_PAGES; list++) {
+    if (free_spans[list] != NULL) {
+      return free_spans[list];
+    }
+  }
+  Span *best = NULL;
+  for (Span *span = free_spans[0]; span != NULL; span = span->next) {
+    if (span->pages >= pages && (best == NULL || span->pages < best->pages)) {
+      best = span;
+    }
+  }
+  return best;
+}
+
+/* Adds `size` bytes at `mem` to the free spans. */
+static void add_memory(void *mem, size_t size) {
+  Span *span = new_descriptor();
+  span->start = mem;
+  span->pages = size >> MY_PAGE_SHIFT;
+  stats.mapped += size;
+  stats.free += size;
+  insert_free(span);
+}
+
+void my_pages_add(void *mem, size_t size) {
+  pthread_mutex_lock(&pages_lock);
+  add_memory(mem, size);
+  pthread_mutex_unlock(&pages_lock);
+}
+
+Span *my_span_alloc(size_t pages, int kind) {
+  pthread_mutex_lock(&pages_lock);
+  Span *span = find_free(pages);
+  if (span == NULL) {
+    size_t grow = pages > GROW_PAGES ? pages : GROW_PAGES;
+    add_memory(map_pages(grow << MY_PAGE_SHIFT), grow << MY_PAGE_SHIFT);
+    span = find_free(pages);
+  }
+  remove_free(span);
+  if (span->pages > pages) {
+    // The rest stays free, its neighbours aren't
+    Span *rest = new_descriptor();
+    rest->start = span->start + (pages << MY_PAGE_SHIFT);
+    rest->pages = span->pages - pages;
+    push_free(rest);
+    span->pages = pages;
+  }
+  span->kind = kind;
+  span->prev = span->next = NULL;
+  // A reused span still has the slab state of its last use
+  memset(&span->slab, 0, sizeof(span->slab));
+  set_pages(span, span);
+  stats.in_use += pages << MY_PAGE_SHIFT;
+  stats.free -= pages << MY_PAGE_SHIFT;
+  pthread_mutex_unlock(&pages_lock);
+  return span;
+}
+
+void my_span_free(Span *span) {
+  madvise(span->start, span->pages << MY_PAGE_SHIFT, MADV_DONTNEED);
+  pthread_mutex_lock(&pages_lock);
+  set_pages(span, NULL);
+  stats.in_use -= span->pages << MY_PAGE_SHIFT;
+  stats.free += span->pages << MY_PAGE_SHIFT;
+  insert_free(span);
+  pthread_mutex_unlock(&pages_lock);
+}
+
+Span *my_span_register(void *mem, size_t size, int kind) {
+  pthread_mutex_lock(&pages_lock);
+  Span *span = new_descriptor();
+  span->start = mem;
+  span->pages = size >> MY_PAGE_SHIFT;
+  span->kind = kind;
+  set_page(span->start, span);
+  pthread_mutex_unlock(&pages_lock);
+  return span;
+}
+
+void my_span_unregister(Span *span) {
+  pthread_mutex_lock(&pages_lock);
+  set_page(span->start, NULL);
+  delete_descriptor(span);
+  pthread_mutex_unlock(&pages_lock);
+}
+
+void my_pages_stats(struct MyPageStats *out) {
+  pthread_mutex_lock(&pages_lock);
+  *out = stats;
+  pthread_mutex_unlock(&pages_lock);
+}
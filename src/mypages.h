@@ -0,0 +1,104 @@
+#ifndef MYPAGES_HEADER
+#define MYPAGES_HEADER
+
+#include "mymalloc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Page heap: memory is handed out in spans, runs of MY_PAGE_SIZE byte pages,
+ *  each described by a Span kept outside of the memory itself. A page map
+ *  from page number to Span finds the span of any address in two loads, and
+ *  lets a freed span merge with its free neighbours. The pages of a span
+ *  going back to the page heap are returned to the kernel
+ *  (MADV_DONTNEED), and are faulted back in as zeroes when reused.
+ *
+ *  mymalloc builds on it: the slabs behind the thread cache (see mycache.h)
+ *  are spans taken from the page heap, and huge blocks, which keep mappings
+ *  of their own so they can be remapped, are registered in the page map as
+ *  spans of their own. Its boundary tag heaps live in a range of their own,
+ *  outside the page map.
+ **/
+
+#define MY_PAGE_SHIFT 12
+#define MY_PAGE_SIZE ((size_t) 1 << MY_PAGE_SHIFT)
+
+// Kinds of span
+#define MY_SPAN_FREE 0
+// Blocks of one size class for the thread cache
+#define MY_SPAN_SLAB 2
+// A huge block, with a mapping of its own
+#define MY_SPAN_LARGE 3
+
+typedef struct Span Span;
+
+struct Span {
+  char *start;
+  size_t pages;
+  int kind;
+  // Free list of the page heap, or slab list of a size class
+  Span *prev;
+  Span *next;
+  struct {
+    // Freed blocks, linked through their first word
+    void *free;
+    // Blocks handed out and blocks ever carved off the span
+    unsigned used;
+    unsigned carved;
+    unsigned capacity;
+    int size_class;
+  } slab;
+};
+
+struct MyPageStats {
+  // Bytes the page heap has mapped, bytes in spans in use, and bytes in
+  // free spans, whose pages the kernel has back (or never handed out)
+  size_t mapped;
+  size_t in_use;
+  size_t free;
+};
+
+/* Sets the function the page heap maps memory with, which returns `size`
+   bytes, page aligned. Until it is set, the page heap uses mmap. */
+void my_pages_init(void *(*map)(size_t size));
+
+/* Returns a span of `pages` pages of the given kind, every page of which
+   maps to it. Exits if memory can't be mapped. */
+Span *my_span_alloc(size_t pages, int kind);
+/* Gives a span from my_span_alloc back, and its pages to the kernel. */
+void my_span_free(Span *span);
+/* Adds memory mapped elsewhere, page aligned, to the page heap. */
+void my_pages_add(void *mem, size_t size);
+
+/* Registers memory that isn't the page heap's, like a huge block's own
+   mapping, as a span of `kind` whose first page maps to it, and
+   unregisters it. */
+Span *my_span_register(void *mem, size_t size, int kind);
+void my_span_unregister(Span *span);
+
+void my_pages_stats(struct MyPageStats *stats);
+
+/* Page map: two levels of MY_PAGE_MAP_BITS bits of page number, which cover
+   48 bit addresses. The leaves are mapped as they are needed. */
+#define MY_PAGE_MAP_BITS 18
+#define MY_PAGE_MAP_LEAF ((size_t) 1 << MY_PAGE_MAP_BITS)
+
+extern Span **my_page_map[MY_PAGE_MAP_LEAF];
+
+/* Returns the span of the page `ptr` is in, or NULL. Only the first page of
+   a registered span maps to it, and the first and last of a free span. */
+static inline Span *my_span_of(const void *ptr) {
+  uintptr_t page = (uintptr_t) ptr >> MY_PAGE_SHIFT;
+  if (page >> (2 * MY_PAGE_MAP_BITS) != 0) {
+    return NULL;
+  }
+  Span **leaf = __atomic_load_n(&my_page_map[page >> MY_PAGE_MAP_BITS], __ATOMIC_ACQUIRE);
+  return leaf != NULL ? __atomic_load_n(&leaf[page & (MY_PAGE_MAP_LEAF - 1)], __ATOMIC_ACQUIRE) : NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
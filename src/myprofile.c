@@ -0,0 +1,388 @@
+#define _GNU_SOURCE
+#include "myprofile.h"
+#include <errno.h>
+#include <execinfo.h>
+#include <link.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// Frames kept per backtrace
+#define MAX_FRAMES 32
+// Frames captured beyond those kept, for the ones in this library on top
+#define EXTRA_FRAMES 8
+// Distinct backtraces, and sampled blocks alive at once, the tables hold
+// (powers of two). Samples past that are dropped.
+#define STACK_SLOTS 4096
+#define SAMPLE_SLOTS 65536
+// Countdown while sampling is off, so threads still notice it turned on
+#define IDLE_COUNTDOWN ((ssize_t) 1 << 30)
+
+typedef struct ProfileStack ProfileStack;
+typedef struct ProfileSample ProfileSample;
+
+struct ProfileStack {
+  uint64_t hash;
+  int depth;
+  void *frames[MAX_FRAMES];
+  // Sampled allocations and their bytes, and how many of them were freed
+  size_t allocs;
+  size_t alloc_bytes;
+  size_t frees;
+  size_t free_bytes;
+  // The same for the allocations the samples stand for
+  double est_allocs;
+  double est_bytes;
+  double est_frees;
+  double est_free_bytes;
+  // Summed lifetime of the freed samples
+  uint64_t lifetime_ns;
+};
+
+struct ProfileSample {
+  // NULL if the slot is empty
+  void *ptr;
+  ProfileStack *stack;
+  size_t size;
+  uint64_t alloc_ns;
+  // Allocations it stands for
+  double weight;
+};
+
+__thread ssize_t my_profile_countdown __attribute__((tls_model("initial-exec"))) = 0;
+// Period the thread's countdown was drawn with
+static __thread size_t thread_period = 0;
+static __thread uint64_t rng_state = 0;
+// Set while the thread is in the profiler, in case it allocates
+static __thread int in_profiler = 0;
+
+static size_t period = 0;
+static pthread_once_t profile_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static ProfileStack *stacks = NULL;
+static ProfileSample *samples = NULL;
+static size_t n_stacks = 0, n_samples = 0, dropped = 0;
+static volatile sig_atomic_t dump_requested = 0;
+// Address range of this library's segments
+static uintptr_t library_start = 0, library_end = 0;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void *map_table(size_t size) {
+  void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    fprintf(stderr, "mmap failed with error: %s\n", strerror(errno));
+    exit(1);
+  }
+  return mem;
+}
+
+static void dump_signal(int sig) {
+  dump_requested = 1;
+  // Sends this thread's next my_malloc down the slow path
+  my_profile_countdown = 0;
+}
+
+/* dl_iterate_phdr callback: records the range of the object that contains
+   the profiler. */
+static int find_library(struct dl_phdr_info *info, size_t size, void *data) {
+  uintptr_t start = UINTPTR_MAX, end = 0;
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+    if (phdr->p_type == PT_LOAD) {
+      uintptr_t lo = info->dlpi_addr + phdr->p_vaddr;
+      start = lo < start ? lo : start;
+      end = lo + phdr->p_memsz > end ? lo + phdr->p_memsz : end;
+    }
+  }
+  uintptr_t self = (uintptr_t) my_profile_malloc;
+  if (self >= start && self < end) {
+    library_start = start;
+    library_end = end;
+    return 1;
+  }
+  return 0;
+}
+
+static void profile_init(void) {
+  const char *env = getenv("MYMALLOC_PROFILE");
+  if (env != NULL && strtoull(env, NULL, 0) > 0) {
+    my_profile_set_period(strtoull(env, NULL, 0));
+  }
+}
+
+void my_profile_set_period(size_t bytes) {
+  pthread_mutex_lock(&profile_lock);
+  if (bytes > 0 && stacks == NULL) {
+    stacks = map_table(STACK_SLOTS * sizeof(ProfileStack));
+    samples = map_table(SAMPLE_SLOTS * sizeof(ProfileSample));
+    // backtrace loads libgcc on its first call, which may allocate
+    void *frame;
+    in_profiler = 1;
+    backtrace(&frame, 1);
+    in_profiler = 0;
+    dl_iterate_phdr(find_library, NULL);
+    struct sigaction action = {0};
+    action.sa_handler = dump_signal;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR2, &action, NULL);
+  }
+  __atomic_store_n(&period, bytes, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&profile_lock);
+  my_profile_countdown = 0;
+}
+
+/* Returns the bytes until the next sample: exponentially distributed with
+   mean `p`, which makes the sampled bytes a Poisson process. */
+static ssize_t next_distance(size_t p) {
+  if (rng_state == 0) {
+    rng_state = now_ns() ^ (uint64_t) (uintptr_t) &rng_state;
+  }
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  double u = ((rng_state >> 11) + 1) * 0x1p-53;
+  double distance = -log(u) * (double) p;
+  return distance < 1 ? 1 : distance > 0x1p60 ? (ssize_t) 1 << 60 : (ssize_t) distance;
+}
+
+static int in_library(void *frame) {
+  return (uintptr_t) frame >= library_start && (uintptr_t) frame < library_end;
+}
+
+/* Returns the number of frames on top of a backtrace up to the last one in
+   this library: the profiler, the allocator and wrappers like
+   my_arena_alloc (and a backtrace interceptor, as ASan has). */
+static int library_frames(void **frames, int depth) {
+  int n = 0;
+  while (n < depth && !in_library(frames[n])) {
+    n++;
+  }
+  while (n < depth && in_library(frames[n])) {
+    n++;
+  }
+  // Linked into the program itself: skip the profiler and my_malloc only
+  return n < depth ? n : 2;
+}
+
+static uint64_t hash_frames(void **frames, int depth) {
+  uint64_t h = 14695981039346656037ull;
+  for (int i = 0; i < depth; i++) {
+    h = (h ^ (uint64_t) (uintptr_t) frames[i]) * 1099511628211ull;
+  }
+  return h;
+}
+
+static size_t sample_slot(void *ptr) {
+  return (size_t) (((uintptr_t) ptr >> 3) * 0x9e3779b97f4a7c15ull >> 32) & (SAMPLE_SLOTS - 1);
+}
+
+/* Returns the entry of a backtrace, adding it if it is new, or NULL if the
+   table is full. */
+static ProfileStack *find_stack(void **frames, int depth) {
+  uint64_t h = hash_frames(frames, depth);
+  for (size_t i = h & (STACK_SLOTS - 1);; i = (i + 1) & (STACK_SLOTS - 1)) {
+    ProfileStack *stack = &stacks[i];
+    if (stack->depth == 0) {
+      if (n_stacks >= STACK_SLOTS * 3 / 4) {
+        return NULL;
+      }
+      n_stacks++;
+      stack->hash = h;
+      stack->depth = depth;
+      memcpy(stack->frames, frames, depth * sizeof(void *));
+      return stack;
+    }
+    if (stack->hash == h && stack->depth == depth && memcmp(stack->frames, frames, depth * sizeof(void *)) == 0) {
+      return stack;
+    }
+  }
+}
+
+int my_profile_malloc(void *ptr, size_t size) {
+  if (in_profiler) {
+    return 0;
+  }
+  pthread_once(&profile_once, profile_init);
+  if (dump_requested) {
+    dump_requested = 0;
+    const char *path = getenv("MYMALLOC_PROFILE_FILE");
+    const char *format = getenv("MYMALLOC_PROFILE_FORMAT");
+    char buf[64];
+    if (path == NULL) {
+      snprintf(buf, sizeof(buf), "mymalloc.%d.heap", (int) getpid());
+      path = buf;
+    }
+    my_profile_dump(path, format != NULL && strcmp(format, "text") == 0 ? MY_PROFILE_TEXT : MY_PROFILE_PPROF);
+    // Not a real sample, the signal cut the countdown short
+    thread_period = 0;
+  }
+
+  size_t p = __atomic_load_n(&period, __ATOMIC_RELAXED);
+  if (p == 0) {
+    thread_period = 0;
+    my_profile_countdown = IDLE_COUNTDOWN;
+    return 0;
+  }
+  my_profile_countdown = next_distance(p);
+  if (thread_period != p) {
+    // The countdown wasn't drawn with this period, start afresh
+    thread_period = p;
+    return 0;
+  }
+
+  in_profiler = 1;
+  void *frames[MAX_FRAMES + EXTRA_FRAMES];
+  int depth = backtrace(frames, MAX_FRAMES + EXTRA_FRAMES);
+  int skip = library_frames(frames, depth);
+  depth = depth - skip < MAX_FRAMES ? depth - skip : MAX_FRAMES;
+  // Each sample stands for 1 / P(an allocation of this size is sampled)
+  double weight = 1 / (1 - exp(-(double) size / p));
+  uint64_t alloc_ns = now_ns();
+
+  pthread_mutex_lock(&profile_lock);
+  ProfileStack *stack = depth > 0 && n_samples < SAMPLE_SLOTS * 3 / 4 ? find_stack(frames + skip, depth) : NULL;
+  if (stack == NULL) {
+    dropped++;
+    pthread_mutex_unlock(&profile_lock);
+    in_profiler = 0;
+    return 0;
+  }
+  size_t i = sample_slot(ptr);
+  while (samples[i].ptr != NULL) {
+    i = (i + 1) & (SAMPLE_SLOTS - 1);
+  }
+  samples[i] = (ProfileSample) {ptr, stack, size, alloc_ns, weight};
+  n_samples++;
+  stack->allocs++;
+  stack->alloc_bytes += size;
+  stack->est_allocs += weight;
+  stack->est_bytes += weight * size;
+  pthread_mutex_unlock(&profile_lock);
+  in_profiler = 0;
+  return 1;
+}
+
+void my_profile_free(void *ptr) {
+  uint64_t free_ns = now_ns();
+  pthread_mutex_lock(&profile_lock);
+  size_t i = sample_slot(ptr);
+  while (samples != NULL && samples[i].ptr != ptr && samples[i].ptr != NULL) {
+    i = (i + 1) & (SAMPLE_SLOTS - 1);
+  }
+  if (samples == NULL || samples[i].ptr == NULL) {
+    pthread_mutex_unlock(&profile_lock);
+    return;
+  }
+  ProfileSample *sample = &samples[i];
+  ProfileStack *stack = sample->stack;
+  stack->frees++;
+  stack->free_bytes += sample->size;
+  stack->est_frees += sample->weight;
+  stack->est_free_bytes += sample->weight * sample->size;
+  stack->lifetime_ns += free_ns - sample->alloc_ns;
+  n_samples--;
+
+  // Shift later entries of the probe sequence back into the hole
+  size_t hole = i;
+  for (size_t j = (i + 1) & (SAMPLE_SLOTS - 1); samples[j].ptr != NULL; j = (j + 1) & (SAMPLE_SLOTS - 1)) {
+    size_t home = sample_slot(samples[j].ptr);
+    // Movable unless its home lies cyclically in (hole, j]
+    if (((j - home) & (SAMPLE_SLOTS - 1)) >= ((j - hole) & (SAMPLE_SLOTS - 1))) {
+      samples[hole] = samples[j];
+      hole = j;
+    }
+  }
+  samples[hole].ptr = NULL;
+  pthread_mutex_unlock(&profile_lock);
+}
+
+static int by_in_use_bytes(const void *a, const void *b) {
+  const ProfileStack *x = *(ProfileStack *const *) a, *y = *(ProfileStack *const *) b;
+  double in_use_x = x->est_bytes - x->est_free_bytes, in_use_y = y->est_bytes - y->est_free_bytes;
+  return in_use_x < in_use_y ? 1 : in_use_x > in_use_y ? -1 : 0;
+}
+
+static void write_pprof(FILE *f, ProfileStack **sorted, size_t n) {
+  size_t in_use = 0, in_use_bytes = 0, allocs = 0, alloc_bytes = 0;
+  for (size_t i = 0; i < n; i++) {
+    in_use += sorted[i]->allocs - sorted[i]->frees;
+    in_use_bytes += sorted[i]->alloc_bytes - sorted[i]->free_bytes;
+    allocs += sorted[i]->allocs;
+    alloc_bytes += sorted[i]->alloc_bytes;
+  }
+  fprintf(f, "heap profile: %6zu: %8zu [%6zu: %8zu] @ heap_v2/%zu\n", in_use, in_use_bytes, allocs, alloc_bytes, period);
+  for (size_t i = 0; i < n; i++) {
+    ProfileStack *s = sorted[i];
+    fprintf(f, "%6zu: %8zu [%6zu: %8zu] @", s->allocs - s->frees, s->alloc_bytes - s->free_bytes, s->allocs, s->alloc_bytes);
+    for (int d = 0; d < s->depth; d++) {
+      fprintf(f, " %p", s->frames[d]);
+    }
+    fprintf(f, "\n");
+  }
+  // pprof symbolizes with the mappings
+  fprintf(f, "\nMAPPED_LIBRARIES:\n");
+  FILE *maps = fopen("/proc/self/maps", "r");
+  if (maps != NULL) {
+    char buf[4096];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), maps)) > 0) {
+      fwrite(buf, 1, len, f);
+    }
+    fclose(maps);
+  }
+}
+
+static void write_text(FILE *f, ProfileStack **sorted, size_t n) {
+  fprintf(f, "mymalloc heap profile: one sample per %zu bytes, %zu samples dropped\n", period, dropped);
+  fprintf(f, "estimated bytes (objects) in use and allocated, mean lifetime of the freed samples\n");
+  for (size_t i = 0; i < n; i++) {
+    ProfileStack *s = sorted[i];
+    fprintf(f, "\n%12.0f (%8.0f) in use  %12.0f (%8.0f) allocated", s->est_bytes - s->est_free_bytes,
+            s->est_allocs - s->est_frees, s->est_bytes, s->est_allocs);
+    if (s->frees > 0) {
+      fprintf(f, "  lifetime %.3f ms", s->lifetime_ns / 1e6 / s->frees);
+    }
+    fprintf(f, "\n");
+    fflush(f);
+    backtrace_symbols_fd(s->frames, s->depth, fileno(f));
+  }
+}
+
+int my_profile_dump(const char *path, int format) {
+  in_profiler = 1;
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    in_profiler = 0;
+    return -1;
+  }
+  pthread_mutex_lock(&profile_lock);
+  static ProfileStack *sorted[STACK_SLOTS];
+  size_t n = 0;
+  for (size_t i = 0; stacks != NULL && i < STACK_SLOTS; i++) {
+    if (stacks[i].depth > 0) {
+      sorted[n++] = &stacks[i];
+    }
+  }
+  qsort(sorted, n, sizeof(ProfileStack *), by_in_use_bytes);
+  if (format == MY_PROFILE_TEXT) {
+    write_text(f, sorted, n);
+  } else {
+    write_pprof(f, sorted, n);
+  }
+  pthread_mutex_unlock(&profile_lock);
+  int failed = fclose(f) != 0;
+  in_profiler = 0;
+  return failed ? -1 : 0;
+}
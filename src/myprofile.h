@@ -0,0 +1,53 @@
+#ifndef MYPROFILE_HEADER
+#define MYPROFILE_HEADER
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Sampling heap profiler: with MYMALLOC_PROFILE=<bytes> in the environment
+ *  (or after my_profile_set_period), my_malloc samples about one allocation
+ *  per <bytes> allocated, recording the allocating backtrace, its size and,
+ *  once it is freed, its lifetime. Sampling is geometric, so every byte is
+ *  equally likely to be sampled and large allocations are picked more often.
+ *
+ *  SIGUSR2 writes a profile to $MYMALLOC_PROFILE_FILE (default
+ *  mymalloc.<pid>.heap) in the format of MYMALLOC_PROFILE_FORMAT (pprof or
+ *  text, default pprof). The dump happens at the signalled thread's next
+ *  my_malloc, not in the handler. Only mymalloc is instrumented.
+ **/
+
+// gperftools heap profile (heap_v2), readable by pprof
+#define MY_PROFILE_PPROF 0
+// Per backtrace estimated bytes and lifetimes, with symbols
+#define MY_PROFILE_TEXT 1
+
+/* Samples one allocation per `bytes` bytes on average; 0 stops sampling.
+   Threads pick up the new period at their next sample (or within 1 GB of
+   allocations if sampling was off). */
+void my_profile_set_period(size_t bytes);
+/* Writes the profile of the allocations sampled so far. Returns 0, or -1 if
+   the file can't be written. */
+int my_profile_dump(const char *path, int format);
+
+/* Hooks for the allocator. Each thread counts down the bytes until its next
+   sample, so an allocation that isn't sampled costs a decrement and a
+   branch:
+
+     if ((my_profile_countdown -= size) < 0 && my_profile_malloc(ptr, size))
+       <mark ptr as sampled>
+
+   and my_profile_free(ptr) is called when a marked block is freed. */
+extern __thread ssize_t my_profile_countdown __attribute__((tls_model("initial-exec")));
+/* Resets the countdown; returns 1 if `ptr` was sampled. */
+int my_profile_malloc(void *ptr, size_t size);
+void my_profile_free(void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,149 @@
+#include "mystream.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+size_t my_stream_threshold = 256 << 10;
+
+#if defined(__x86_64__)
+/* Stores through memcpy up to the first `alignment` boundary of `dst` and
+   returns how many bytes that took. */
+static size_t head_bytes(void *dst, size_t n, size_t alignment) {
+  size_t head = -(uintptr_t) dst & (alignment - 1);
+  return head < n ? head : n;
+}
+
+static void copy_sse2(void *dst, const void *src, size_t n) {
+  size_t head = head_bytes(dst, n, 16);
+  memcpy(dst, src, head);
+  char *d = (char *) dst + head;
+  const char *s = (const char *) src + head;
+  n -= head;
+  for (; n >= 64; n -= 64, d += 64, s += 64) {
+    __m128i a = _mm_loadu_si128((const __m128i *) s);
+    __m128i b = _mm_loadu_si128((const __m128i *) (s + 16));
+    __m128i c = _mm_loadu_si128((const __m128i *) (s + 32));
+    __m128i e = _mm_loadu_si128((const __m128i *) (s + 48));
+    _mm_stream_si128((__m128i *) d, a);
+    _mm_stream_si128((__m128i *) (d + 16), b);
+    _mm_stream_si128((__m128i *) (d + 32), c);
+    _mm_stream_si128((__m128i *) (d + 48), e);
+  }
+  // Orders the streaming stores before the stores that publish the block
+  _mm_sfence();
+  memcpy(d, s, n);
+}
+
+static void zero_sse2(void *dst, size_t n) {
+  size_t head = head_bytes(dst, n, 16);
+  memset(dst, 0, head);
+  char *d = (char *) dst + head;
+  n -= head;
+  __m128i zero = _mm_setzero_si128();
+  for (; n >= 64; n -= 64, d += 64) {
+    _mm_stream_si128((__m128i *) d, zero);
+    _mm_stream_si128((__m128i *) (d + 16), zero);
+    _mm_stream_si128((__m128i *) (d + 32), zero);
+    _mm_stream_si128((__m128i *) (d + 48), zero);
+  }
+  _mm_sfence();
+  memset(d, 0, n);
+}
+
+__attribute__((target("avx2"))) static void copy_avx2(void *dst, const void *src, size_t n) {
+  size_t head = head_bytes(dst, n, 32);
+  memcpy(dst, src, head);
+  char *d = (char *) dst + head;
+  const char *s = (const char *) src + head;
+  n -= head;
+  for (; n >= 128; n -= 128, d += 128, s += 128) {
+    __m256i a = _mm256_loadu_si256((const __m256i *) s);
+    __m256i b = _mm256_loadu_si256((const __m256i *) (s + 32));
+    __m256i c = _mm256_loadu_si256((const __m256i *) (s + 64));
+    __m256i e = _mm256_loadu_si256((const __m256i *) (s + 96));
+    _mm256_stream_si256((__m256i *) d, a);
+    _mm256_stream_si256((__m256i *) (d + 32), b);
+    _mm256_stream_si256((__m256i *) (d + 64), c);
+    _mm256_stream_si256((__m256i *) (d + 96), e);
+  }
+  _mm_sfence();
+  memcpy(d, s, n);
+}
+
+__attribute__((target("avx2"))) static void zero_avx2(void *dst, size_t n) {
+  size_t head = head_bytes(dst, n, 32);
+  memset(dst, 0, head);
+  char *d = (char *) dst + head;
+  n -= head;
+  __m256i zero = _mm256_setzero_si256();
+  for (; n >= 128; n -= 128, d += 128) {
+    _mm256_stream_si256((__m256i *) d, zero);
+    _mm256_stream_si256((__m256i *) (d + 32), zero);
+    _mm256_stream_si256((__m256i *) (d + 64), zero);
+    _mm256_stream_si256((__m256i *) (d + 96), zero);
+  }
+  _mm_sfence();
+  memset(d, 0, n);
+}
+
+static void (*copy_kernel)(void *, const void *, size_t) = copy_sse2;
+static void (*zero_kernel)(void *, size_t) = zero_sse2;
+#else
+static void copy_memcpy(void *dst, const void *src, size_t n) {
+  memcpy(dst, src, n);
+}
+
+static void zero_memset(void *dst, size_t n) {
+  memset(dst, 0, n);
+}
+
+static void (*copy_kernel)(void *, const void *, size_t) = copy_memcpy;
+static void (*zero_kernel)(void *, size_t) = zero_memset;
+#endif
+
+void my_stream_init(void) {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    copy_kernel = copy_avx2;
+    zero_kernel = zero_avx2;
+  }
+#endif
+  long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  if (l2 > 0) {
+    my_stream_threshold = (size_t) l2 / 4;
+  }
+  const char *env = getenv("MYMALLOC_STREAM_THRESHOLD");
+  if (env != NULL) {
+    size_t threshold = strtoul(env, NULL, 0);
+    my_stream_threshold = threshold > 0 ? threshold : SIZE_MAX;
+  }
+}
+
+void my_stream_copy(void *dst, const void *src, size_t n) {
+  copy_kernel(dst, src, n);
+}
+
+void my_stream_zero(void *dst, size_t n) {
+  zero_kernel(dst, n);
+}
+
+void my_copy(void *dst, const void *src, size_t n) {
+  if (n >= my_stream_threshold) {
+    copy_kernel(dst, src, n);
+  } else {
+    memcpy(dst, src, n);
+  }
+}
+
+void my_zero(void *dst, size_t n) {
+  if (n >= my_stream_threshold) {
+    zero_kernel(dst, n);
+  } else {
+    memset(dst, 0, n);
+  }
+}
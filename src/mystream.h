@@ -0,0 +1,41 @@
+#ifndef MYSTREAM_HEADER
+#define MYSTREAM_HEADER
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Streaming copy and zero: the kernels write with non-temporal stores,
+ *  which go to memory without allocating cache lines, so copying or zeroing
+ *  a large block doesn't evict the rest of the program's working set. They
+ *  use AVX2 where the CPU has it and SSE2 otherwise, picked at run time, and
+ *  fall back to memcpy and memset on other architectures.
+ *
+ *  The allocator streams in my_calloc and my_realloc from
+ *  my_stream_threshold bytes: a quarter of the L2 cache, or
+ *  MYMALLOC_STREAM_THRESHOLD bytes from the environment (0 to never stream).
+ *  Below it, the block is better off in the cache its caller is about to
+ *  use it from.
+ **/
+
+extern size_t my_stream_threshold;
+
+/* Picks the kernels and reads the threshold; until then the SSE2 kernels
+   are used. */
+void my_stream_init(void);
+
+void my_stream_copy(void *dst, const void *src, size_t n);
+void my_stream_zero(void *dst, size_t n);
+
+/* memcpy and memset, or the streaming kernels from my_stream_threshold
+   bytes. */
+void my_copy(void *dst, const void *src, size_t n);
+void my_zero(void *dst, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+#include "mytrace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// Events per thread unless MYMALLOC_TRACE_EVENTS says otherwise
+#define DEFAULT_EVENTS 65536
+
+typedef struct Ring Ring;
+
+struct Ring {
+  Ring *next;
+  uint32_t tid;
+  // Power of two
+  uint32_t capacity;
+  // Events recorded: the next one goes to events[recorded & (capacity - 1)]
+  uint64_t recorded;
+  MyTraceEvent events[];
+};
+
+int my_trace_enabled = 0;
+
+static __thread Ring *thread_ring __attribute__((tls_model("initial-exec"))) = NULL;
+// Every ring ever made, newest first. Rings outlive their threads so that a
+// dump still has their events.
+static Ring *rings = NULL;
+static uint32_t ring_capacity = DEFAULT_EVENTS;
+
+static void *map_ring(size_t size) {
+  void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    fprintf(stderr, "mmap failed with error: %s\n", strerror(errno));
+    exit(1);
+  }
+  return mem;
+}
+
+static Ring *new_ring(void) {
+  uint32_t capacity = __atomic_load_n(&ring_capacity, __ATOMIC_RELAXED);
+  Ring *ring = map_ring(sizeof(Ring) + capacity * sizeof(MyTraceEvent));
+  ring->tid = (uint32_t) syscall(SYS_gettid);
+  ring->capacity = capacity;
+  ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+  }
+  return ring;
+}
+
+static void dump_at_exit(void) {
+  const char *path = getenv("MYMALLOC_TRACE_FILE");
+  char buf[64];
+  if (path == NULL) {
+    snprintf(buf, sizeof(buf), "mymalloc.%d.trace", (int) getpid());
+    path = buf;
+  }
+  if (my_trace_dump(path) != 0) {
+    fprintf(stderr, "cannot write trace %s: %s\n", path, strerror(errno));
+  }
+}
+
+void my_trace_init(void) {
+  const char *events = getenv("MYMALLOC_TRACE_EVENTS");
+  if (events != NULL && strtoul(events, NULL, 0) > 0) {
+    // Rounded up to a power of two, so the ring index is a mask
+    uint32_t capacity = 1;
+    while (capacity < strtoul(events, NULL, 0) && capacity < (1u << 31)) {
+      capacity *= 2;
+    }
+    ring_capacity = capacity;
+  }
+  const char *env = getenv("MYMALLOC_TRACE");
+  if (env != NULL && atoi(env) != 0) {
+    atexit(dump_at_exit);
+    my_trace_enable(1);
+  }
+}
+
+void my_trace_enable(int on) {
+  __atomic_store_n(&my_trace_enabled, on != 0, __ATOMIC_RELAXED);
+}
+
+void my_trace_record(uint32_t type, const void *addr, size_t size, size_t arg) {
+  Ring *ring = thread_ring;
+  if (ring == NULL) {
+    ring = thread_ring = new_ring();
+  }
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  uint64_t n = ring->recorded;
+  MyTraceEvent *event = &ring->events[n & (ring->capacity - 1)];
+  event->time_ns = (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+  event->addr = (uint64_t) (uintptr_t) addr;
+  event->size = size;
+  event->type = type;
+  event->arg = (uint32_t) arg;
+  // Publishes the event to my_trace_dump
+  __atomic_store_n(&ring->recorded, n + 1, __ATOMIC_RELEASE);
+}
+
+static int write_all(int fd, const void *data, size_t size) {
+  const char *p = data;
+  while (size > 0) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return -1;
+    }
+    p += n;
+    size -= (size_t) n;
+  }
+  return 0;
+}
+
+/* Copies the events of a ring that its thread may still be recording into
+   `copy` and fills in `info`, with the intact events from copy[*first]. */
+static void copy_ring(Ring *ring, MyTraceEvent *copy, MyTraceRing *info, uint64_t *first) {
+  uint64_t mask = ring->capacity - 1;
+  uint64_t end = __atomic_load_n(&ring->recorded, __ATOMIC_ACQUIRE);
+  uint64_t start = end > ring->capacity ? end - ring->capacity : 0;
+  for (uint64_t i = start; i < end; i++) {
+    copy[i - start] = ring->events[i & mask];
+  }
+  // Event i shares its slot with event i + capacity, which may have been
+  // recorded over it during the copy
+  uint64_t now = __atomic_load_n(&ring->recorded, __ATOMIC_ACQUIRE);
+  uint64_t intact = now >= ring->capacity ? now - ring->capacity + 1 : 0;
+  *first = intact > start ? intact - start : 0;
+  info->tid = ring->tid;
+  info->capacity = ring->capacity;
+  info->recorded = end;
+  info->count = end > start + *first ? end - start - *first : 0;
+}
+
+int my_trace_dump(const char *path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return -1;
+  }
+  Ring *head = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+  MyTraceHeader header = {MY_TRACE_MAGIC, sizeof(MyTraceEvent), 0};
+  uint32_t capacity = 0;
+  for (Ring *ring = head; ring != NULL; ring = ring->next) {
+    header.rings++;
+    capacity = ring->capacity > capacity ? ring->capacity : capacity;
+  }
+  int failed = write_all(fd, &header, sizeof(header));
+  MyTraceEvent *copy = capacity > 0 ? map_ring(capacity * sizeof(MyTraceEvent)) : NULL;
+  for (Ring *ring = head; ring != NULL && !failed; ring = ring->next) {
+    MyTraceRing info;
+    uint64_t first;
+    copy_ring(ring, copy, &info, &first);
+    failed = write_all(fd, &info, sizeof(info)) || write_all(fd, copy + first, info.count * sizeof(MyTraceEvent));
+  }
+  if (copy != NULL) {
+    munmap(copy, capacity * sizeof(MyTraceEvent));
+  }
+  failed |= close(fd) != 0;
+  return failed ? -1 : 0;
+}
@@ -0,0 +1,91 @@
+#ifndef MYTRACE_HEADER
+#define MYTRACE_HEADER
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Event tracing: with MYMALLOC_TRACE=1 in the environment (or after
+ *  my_trace_enable(1)) the allocator records binary events into a ring of
+ *  fixed size per thread, without locks or system calls. Each ring keeps the
+ *  last MYMALLOC_TRACE_EVENTS (default 65536) events of its thread.
+ *
+ *  my_trace_dump writes the rings of every thread, including those that
+ *  exited, to a file; with MYMALLOC_TRACE set, so does the exit of the
+ *  program, to $MYMALLOC_TRACE_FILE (default mymalloc.<pid>.trace).
+ *  tracedump.py decodes the file to text or JSON. Only mymalloc and mygc are
+ *  instrumented.
+ **/
+
+// A block of `size` bytes requested was returned; arg is the block size
+#define MY_TRACE_ALLOC 1
+// A block of `size` bytes was freed
+#define MY_TRACE_FREE 2
+// A free block was cut down to `size` bytes, arg bytes were split off it
+#define MY_TRACE_SPLIT 3
+// Free blocks were merged into one of `size` bytes; arg is how many
+#define MY_TRACE_COALESCE 4
+// A chunk of `size` bytes was mapped, or a heap grew by that much at ptr;
+// arg is its NUMA node
+#define MY_TRACE_CHUNK_MAP 5
+// A thread cache took arg blocks of `size` bytes from its heap
+#define MY_TRACE_CACHE_REFILL 6
+
+/* The file my_trace_dump writes, in native byte order: a MyTraceHeader, then
+   for each thread a MyTraceRing followed by its `count` events, oldest
+   first. */
+#define MY_TRACE_MAGIC "MYTRACE1"
+
+typedef struct MyTraceHeader {
+  char magic[8];
+  uint32_t event_size;
+  uint32_t rings;
+} MyTraceHeader;
+
+typedef struct MyTraceRing {
+  uint32_t tid;
+  uint32_t capacity;
+  // Events the thread recorded, of which the last `count` follow
+  uint64_t recorded;
+  uint64_t count;
+} MyTraceRing;
+
+typedef struct MyTraceEvent {
+  // CLOCK_MONOTONIC
+  uint64_t time_ns;
+  uint64_t addr;
+  uint64_t size;
+  uint32_t type;
+  uint32_t arg;
+} MyTraceEvent;
+
+/* Tests before every event, so a disabled trace costs a load and a branch:
+
+     if (__builtin_expect(my_trace_enabled, 0)) my_trace_record(...) */
+extern int my_trace_enabled;
+
+#define MY_TRACE(type, addr, size, arg)                                    \
+  do {                                                                     \
+    if (__builtin_expect(my_trace_enabled, 0)) {                           \
+      my_trace_record((type), (const void *) (addr), (size), (arg));       \
+    }                                                                      \
+  } while (0)
+
+/* Reads MYMALLOC_TRACE and MYMALLOC_TRACE_EVENTS; called by the allocator
+   before its first event. */
+void my_trace_init(void);
+void my_trace_enable(int on);
+void my_trace_record(uint32_t type, const void *addr, size_t size, size_t arg);
+/* Writes the rings to `path`. Threads may keep recording meanwhile; events
+   they overwrite during the copy are left out. Returns 0, or -1 if the file
+   can't be written. */
+int my_trace_dump(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
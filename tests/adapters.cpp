@@ -0,0 +1,115 @@
+#define MYMALLOC_REPLACE_NEW
+#include "../src/mymalloc.hpp"
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+/**
+ * This test checks the C++ adapters of src/mymalloc.hpp: the replaced
+ * operator new and delete, for alignments above kAlignment too, where the
+ * block from my_malloc is kept in the word below the aligned pointer; a
+ * std::pmr::vector growing through mymalloc::memory_resource(); and
+ * mymalloc::Allocator<T> in a std::map and a std::vector. Every pointer
+ * must be aligned, lie in an allocated block of ours, and keep what was
+ * written to it.
+ *
+ * Reason(s) you may fail this test:
+ * - An aligned pointer isn't aligned, or is freed as if it were the block.
+ * - A deallocation frees the wrong size or the wrong block.
+ */
+
+#define N 1000
+
+template <std::size_t A>
+struct alignas(A) Aligned {
+  unsigned char bytes[A];
+};
+
+/* Checks that `p` is aligned and lies in an allocated block of ours. */
+static void check_block(void *p, std::size_t alignment) {
+  assert(reinterpret_cast<std::uintptr_t>(p) % alignment == 0);
+  void *block = p;
+  if (alignment > mymalloc::kBaseAlignment) {
+    block = static_cast<void **>(p)[-1];
+    assert(block < p && static_cast<char *>(p) - static_cast<char *>(block) <= (std::ptrdiff_t) (alignment + sizeof(void *)));
+  }
+  assert(!is_free(ptr_to_block(block)));
+}
+
+template <std::size_t A>
+static void check_aligned_new() {
+  static Aligned<A> *objects[N];
+  for (int i = 0; i < N; i++) {
+    objects[i] = new Aligned<A>;
+    check_block(objects[i], A);
+    memset(objects[i]->bytes, i & 0xff, A);
+  }
+  Aligned<A> *array = new Aligned<A>[3];
+  check_block(array, A);
+  memset(array, 0xff, sizeof(Aligned<A>) * 3);
+  void *raw = operator new(A / 2, std::align_val_t(A));
+  check_block(raw, A);
+  void *nothrow = operator new(A, std::align_val_t(A), std::nothrow);
+  check_block(nothrow, A);
+  for (int i = 0; i < N; i++) {
+    for (std::size_t j = 0; j < A; j++) {
+      assert(objects[i]->bytes[j] == (i & 0xff));
+    }
+    delete objects[i];
+  }
+  delete[] array;
+  operator delete(raw, std::align_val_t(A));
+  operator delete(nothrow, std::align_val_t(A), std::nothrow);
+}
+
+int main() {
+  check_aligned_new<32>();
+  check_aligned_new<64>();
+  check_aligned_new<4096>();
+
+  std::pmr::vector<std::uint64_t> numbers(mymalloc::memory_resource());
+  for (std::uint64_t i = 0; i < 100 * N; i++) {
+    numbers.push_back(i);
+    if ((i & (i + 1)) == 0) {
+      // Just grown
+      check_block(numbers.data(), alignof(std::uint64_t));
+    }
+  }
+  for (std::uint64_t i = 0; i < 100 * N; i++) {
+    assert(numbers[i] == i);
+  }
+  std::pmr::vector<Aligned<64>> lines(mymalloc::memory_resource());
+  for (int i = 0; i < N; i++) {
+    lines.push_back(Aligned<64>{});
+    lines.back().bytes[0] = i & 0xff;
+    check_block(lines.data(), 64);
+  }
+  for (int i = 0; i < N; i++) {
+    assert(lines[i].bytes[0] == (i & 0xff));
+  }
+  mymalloc::MemoryResource other;
+  assert(other.is_equal(*mymalloc::memory_resource()));
+
+  using Pair = std::pair<const int, std::string>;
+  std::map<int, std::string, std::less<int>, mymalloc::Allocator<Pair>> names;
+  for (int i = 0; i < N; i++) {
+    names.emplace(i, std::string(40, 'a' + i % 26));
+  }
+  for (int i = 0; i < N; i += 2) {
+    names.erase(i);
+  }
+  assert(names.size() == N / 2);
+  for (const Pair &name : names) {
+    assert(name.first % 2 == 1 && name.second == std::string(40, 'a' + name.first % 26));
+  }
+  std::vector<Aligned<128>, mymalloc::Allocator<Aligned<128>>> blocks(N);
+  check_block(blocks.data(), 128);
+  blocks.resize(4 * N);
+  check_block(blocks.data(), 128);
+  return 0;
+}
@@ -0,0 +1,64 @@
+#include "testing.h"
+#include "../src/myarena.h"
+#include <string.h>
+
+/* Checks that arena allocations are aligned and don't overlap, that memory
+   after a mark is handed out again after rewinding, and that a reset arena
+   reuses its first block. An arena with blocks too small for their header
+   still hands out separate memory, and sizes that can't be met fail. */
+
+int main(void) {
+  Arena *arena = my_arena_create(4096);
+  CHECK_NULL(arena);
+  char *first = my_arena_alloc(arena, 1);
+  CHECK_NULL(first);
+
+  char *ptrs[1000];
+  for (int i = 0; i < 1000; i++) {
+    ptrs[i] = my_arena_alloc(arena, 1 + i % 100);
+    CHECK_NULL(ptrs[i]);
+    assert(((size_t) ptrs[i] & (kAlignment - 1)) == 0);
+    memset(ptrs[i], i & 0xff, 1 + i % 100);
+  }
+  for (int i = 0; i < 1000; i++) {
+    for (int j = 0; j < 1 + i % 100; j++) {
+      assert(ptrs[i][j] == (char) (i & 0xff));
+    }
+  }
+
+  // Larger than a block
+  char *large = my_arena_alloc(arena, 10000);
+  CHECK_NULL(large);
+  memset(large, 1, 10000);
+
+  struct ArenaMark mark = my_arena_mark(arena);
+  char *after_mark = my_arena_alloc(arena, 64);
+  my_arena_alloc(arena, 8000);
+  my_arena_rewind(arena, mark);
+  assert(my_arena_alloc(arena, 64) == after_mark);
+
+  my_arena_reset(arena);
+  assert(my_arena_alloc(arena, 1) == first);
+  my_arena_destroy(arena);
+
+  Arena *tiny = my_arena_create(8);
+  CHECK_NULL(tiny);
+  char *small[4];
+  for (int i = 0; i < 4; i++) {
+    small[i] = my_arena_alloc(tiny, 64);
+    CHECK_NULL(small[i]);
+    memset(small[i], i + 1, 64);
+  }
+  char *other = mallocing(32);
+  memset(other, 0xff, 32);
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 64; j++) {
+      assert(small[i][j] == i + 1);
+    }
+  }
+  assert(my_arena_alloc(tiny, SIZE_MAX) == NULL);
+  assert(my_arena_alloc(tiny, SIZE_MAX - 64) == NULL);
+  freeing(other);
+  my_arena_destroy(tiny);
+  return 0;
+}
@@ -0,0 +1,42 @@
+#include "testing.h"
+
+/**
+ * This test fills a heap of more than 4 GB with blocks, frees them all and
+ * allocates them again. The freed space coalesces into blocks larger than a
+ * compact (make COMPACT=1) size tag holds unless the merges stop short of
+ * it, so the second round must fit in the heap the first left behind, in
+ * blocks that don't overlap. Only the pages at the blocks' edges are
+ * written.
+ *
+ * Reason(s) you may fail this test:
+ * - A free block or the wilderness outgrows its size tag and is truncated.
+ */
+
+#define N 10240
+#define SIZE (500 << 10)
+
+static char *ptrs[N];
+
+int main() {
+  for (int i = 0; i < N; i++) {
+    ptrs[i] = mallocing(SIZE);
+  }
+  size_t heap_size = kHeapSize;
+  for (int i = 0; i < N; i++) {
+    freeing(ptrs[i]);
+  }
+  for (int i = 0; i < N; i++) {
+    ptrs[i] = mallocing(SIZE);
+    *(int *) ptrs[i] = i;
+    ptrs[i][SIZE - 1] = (char) i;
+  }
+  if (kHeapSize != heap_size) {
+    fprintf(stderr, "The heap grew from %zu to %zu bytes to allocate what was freed\n", heap_size, kHeapSize);
+    exit(1);
+  }
+  for (int i = 0; i < N; i++) {
+    assert(*(int *) ptrs[i] == i && ptrs[i][SIZE - 1] == (char) i);
+    freeing(ptrs[i]);
+  }
+  return 0;
+}
@@ -0,0 +1,69 @@
+#include "testing.h"
+#include "../src/mystream.h"
+
+/**
+ * This test fills and frees blocks, then checks that my_calloc blocks of
+ * the same sizes, below and above the streaming threshold, come back zeroed,
+ * and that a count and size whose product overflows return NULL. It also
+ * checks the streaming kernels against memcpy at unaligned offsets.
+ *
+ * Reason(s) you may fail this test:
+ * - my_calloc doesn't zero a reused block.
+ * - my_calloc doesn't check for overflow.
+ * - The streaming kernels mishandle the unaligned head or tail.
+ */
+
+static const size_t sizes[] = {24, 4000, 200000, 900000, 3000000};
+#define N_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+int main() {
+  for (size_t i = 0; i < N_SIZES; i++) {
+    char *dirty = mallocing(sizes[i]);
+    memset(dirty, 0xa5, sizes[i]);
+    freeing(dirty);
+    unsigned char *ptr = my_calloc(1, sizes[i]);
+    CHECK_NULL(ptr);
+    for (size_t b = 0; b < sizes[i]; b++) {
+      if (ptr[b] != 0) {
+        fprintf(stderr, "Byte %zu of a %zu byte my_calloc block isn't zero\n", b, sizes[i]);
+        exit(1);
+      }
+    }
+    freeing(ptr);
+  }
+  if (my_calloc(SIZE_MAX / 2, 3) != NULL) {
+    fprintf(stderr, "Expected NULL from my_calloc with an overflowing size\n");
+    exit(1);
+  }
+
+  size_t n = 100000;
+  unsigned char *src = mallocing(n + 64);
+  unsigned char *dst = mallocing(n + 64);
+  for (size_t b = 0; b < n + 64; b++) {
+    src[b] = (unsigned char) (b * 13);
+  }
+  for (size_t offset = 0; offset < 40; offset += 7) {
+    size_t len = n - offset * 3;
+    memset(dst, 0xff, n + 64);
+    my_stream_copy(dst + offset, src + 2 * offset, len);
+    if (memcmp(dst + offset, src + 2 * offset, len) != 0 || dst[offset + len] != 0xff ||
+        (offset > 0 && dst[offset - 1] != 0xff)) {
+      fprintf(stderr, "my_stream_copy of %zu bytes at offset %zu is wrong\n", len, offset);
+      exit(1);
+    }
+    my_stream_zero(dst + offset, len);
+    for (size_t b = 0; b < len; b++) {
+      if (dst[offset + b] != 0) {
+        fprintf(stderr, "my_stream_zero of %zu bytes at offset %zu missed byte %zu\n", len, offset, b);
+        exit(1);
+      }
+    }
+    if (dst[offset + len] != 0xff) {
+      fprintf(stderr, "my_stream_zero wrote past %zu bytes\n", len);
+      exit(1);
+    }
+  }
+  freeing(src);
+  freeing(dst);
+  return 0;
+}
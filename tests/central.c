@@ -0,0 +1,86 @@
+#include "testing.h"
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * This test has several threads allocate objects through the thread cache,
+ * stamp them with their owner, and trade their arrays of objects through a
+ * shared slot, freeing the objects they receive after checking their stamps.
+ * The frees overflow the receiving thread's cache, so batches keep moving
+ * through the central free lists between the threads. Build it with
+ * `make TSAN=1` to run it under ThreadSanitizer.
+ *
+ * Reason(s) you may fail this test:
+ * - A batch is popped from a central list by two threads (ABA), which hands
+ *   out a block twice and overwrites another thread's stamp.
+ * - A batch loses or repeats blocks when the thread cache cuts it.
+ */
+
+#define THREADS 4
+#define ROUNDS 200
+#define N 500
+
+typedef struct {
+  uintptr_t owner;
+  uintptr_t serial;
+  uintptr_t words[2];
+} Object;
+
+static Object **exchange = NULL;
+
+static void check(Object **objects, const char *what) {
+  for (int i = 0; i < N; i++) {
+    if (objects[i]->serial != (uintptr_t) i || objects[i]->words[0] != objects[i]->owner ||
+        objects[i]->words[1] != ~objects[i]->owner) {
+      fprintf(stderr, "Object %d %s was overwritten\n", i, what);
+      exit(1);
+    }
+  }
+}
+
+static void *run(void *arg) {
+  uintptr_t id = (uintptr_t) arg;
+  Object **mine = my_malloc(N * sizeof(Object *));
+  CHECK_NULL(mine);
+  for (int round = 0; round < ROUNDS; round++) {
+    for (int i = 0; i < N; i++) {
+      Object *object = my_new(Object);
+      CHECK_NULL(object);
+      *object = (Object) {id * ROUNDS + round, (uintptr_t) i, {id * ROUNDS + round, ~(id * ROUNDS + round)}};
+      mine[i] = object;
+    }
+    check(mine, "before the exchange");
+    Object **theirs = __atomic_exchange_n(&exchange, mine, __ATOMIC_ACQ_REL);
+    if (theirs == NULL) {
+      mine = my_malloc(N * sizeof(Object *));
+      CHECK_NULL(mine);
+      continue;
+    }
+    check(theirs, "received");
+    for (int i = 0; i < N; i++) {
+      my_delete(theirs[i]);
+    }
+    mine = theirs;
+  }
+  my_free(mine);
+  return NULL;
+}
+
+int main() {
+  pthread_t threads[THREADS];
+  for (uintptr_t i = 0; i < THREADS; i++) {
+    pthread_create(&threads[i], NULL, run, (void *) (i + 1));
+  }
+  for (int i = 0; i < THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  Object **left = exchange;
+  if (left != NULL) {
+    check(left, "left over");
+    for (int i = 0; i < N; i++) {
+      my_delete(left[i]);
+    }
+    my_free(left);
+  }
+  return 0;
+}
@@ -0,0 +1,45 @@
+#include "testing.h"
+
+/**
+ * This test frees the blocks at the bottom and the top of a chunk, each
+ * after the neighbour it has, and then the blocks between them. The block
+ * at the bottom has no block below it and the one at the top reaches the
+ * end fencepost, but both must still merge with their free neighbour, so
+ * the whole range holds a single allocation without the heap growing.
+ *
+ * Reason(s) you may fail this test:
+ * - A block at the edge of a chunk is freed without merging with the
+ *   neighbour it does have.
+ */
+
+#define N 8
+#define SIZE 5000
+
+int main() {
+  char *ptrs[N];
+  for (int i = 0; i < N; i++) {
+    ptrs[i] = mallocing(SIZE);
+  }
+  // The last block takes what is left of the chunk, up to the fencepost
+  Block *rest = get_next_block(ptr_to_block(ptrs[N - 1]));
+  assert(rest != NULL && is_free(rest));
+  char *top = mallocing(block_size(rest) - 2 * kMetadataSize);
+  assert(get_next_block(ptr_to_block(top)) == NULL);
+  size_t heap_size = kHeapSize;
+  size_t range = (char *) ptr_to_block(top) + block_size(ptr_to_block(top)) - (char *) ptr_to_block(ptrs[0]);
+
+  freeing(ptrs[N - 1]);
+  freeing(top);
+  freeing(ptrs[1]);
+  freeing(ptrs[0]);
+  for (int i = 2; i < N - 1; i++) {
+    freeing(ptrs[i]);
+  }
+  char *all = mallocing(range - 2 * kMetadataSize);
+  if (kHeapSize != heap_size || all != ptrs[0]) {
+    fprintf(stderr, "A %zu byte block didn't fit in the %zu bytes freed\n", range - 2 * kMetadataSize, range);
+    exit(1);
+  }
+  freeing(all);
+  return 0;
+}
@@ -0,0 +1,39 @@
+#include "testing.h"
+
+/**
+ * This test frees blocks with my_free_sized, first every other one and then
+ * the rest, so that each of the second half coalesces with both neighbours.
+ * The freed space must then hold an allocation as large as all the blocks
+ * together, without the heap growing. With MYMALLOC_PLACEMENT the block may
+ * start up to a boundary and a free block before the first of them, where
+ * a lead fragment was left when they were placed.
+ *
+ * Reason(s) you may fail this test:
+ * - my_free_sized doesn't coalesce free neighbours.
+ */
+
+#define N 500
+#define SIZE 64
+// A page boundary and a free block below it, at most
+#define LEAD (2 << 12)
+
+int main() {
+  char *ptrs[N];
+  char *lo = NULL, *hi = NULL;
+  for (int i = 0; i < N; i++) {
+    ptrs[i] = mallocing(SIZE);
+    if (lo == NULL || ptrs[i] < lo) lo = ptrs[i];
+    if (hi == NULL || ptrs[i] > hi) hi = ptrs[i];
+  }
+  size_t heap_size = kHeapSize;
+  for (int i = 0; i < N; i += 2) {
+    my_free_sized(ptrs[i], SIZE);
+  }
+  for (int i = 1; i < N; i += 2) {
+    my_free_sized(ptrs[i], SIZE);
+  }
+  char *big = mallocing(N * SIZE);
+  assert(kHeapSize == heap_size);
+  assert(big >= lo - LEAD && big <= hi);
+  my_free_sized(big, N * SIZE);
+}
@@ -0,0 +1,43 @@
+#include "testing.h"
+
+/**
+ * This test grows the heap a few times with blocks that fill it, frees them
+ * all, and then allocates a block larger than any one growth of the heap.
+ * The memory added by each growth must have merged with the free space
+ * before it, so the block fits in the freed heap without the heap growing
+ * again.
+ *
+ * Reason(s) you may fail this test:
+ * - The heap doesn't grow contiguously, or free space doesn't coalesce
+ *   across the points where it grew.
+ */
+
+#define N 64
+#define SIZE (16 << 10)
+// Heap size after three growths, of 64, 128 and 256 KB
+#define GROWN ((64 + 128 + 256) << 10)
+#define LARGE (400 << 10)
+
+int main() {
+  char *ptrs[N];
+  char *lo = NULL, *hi = NULL;
+  int n = 0;
+  while (n < N && kHeapSize < GROWN) {
+    ptrs[n] = mallocing(SIZE);
+    if (lo == NULL || ptrs[n] < lo) lo = ptrs[n];
+    if (hi == NULL || ptrs[n] > hi) hi = ptrs[n];
+    n++;
+  }
+  size_t heap_size = kHeapSize;
+  for (int i = 0; i < n; i++) {
+    freeing(ptrs[i]);
+  }
+  char *large = mallocing(LARGE);
+  memset(large, 1, LARGE);
+  if (kHeapSize != heap_size || large < lo || large > hi) {
+    fprintf(stderr, "A %d byte block didn't fit in %zu bytes of freed heap\n", LARGE, heap_size);
+    exit(1);
+  }
+  freeing(large);
+  return 0;
+}
@@ -0,0 +1,69 @@
+#include "testing.h"
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * This test allocates constant-size objects with my_new and my_malloc_inline
+ * from two threads, writes them, checks that live objects don't overlap, and
+ * frees them with my_delete, my_free_inline and my_free. The second thread
+ * exits with blocks in its cache.
+ *
+ * Reason(s) you may fail this test:
+ * - The thread cache hands out a block twice or one that is too small.
+ */
+
+#define N 1000
+
+typedef struct {
+  uint64_t words[5];
+} Object;
+
+static int by_address(const void *a, const void *b) {
+  uintptr_t x = (uintptr_t) *(void *const *) a, y = (uintptr_t) *(void *const *) b;
+  return (x > y) - (x < y);
+}
+
+static void *run(void *arg) {
+  static __thread Object *objects[N];
+  static __thread char *buffers[N];
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < N; i++) {
+      objects[i] = my_new(Object);
+      buffers[i] = my_malloc_inline(100);
+      CHECK_NULL(objects[i]);
+      CHECK_NULL(buffers[i]);
+      assert((uintptr_t) objects[i] % sizeof(size_t) == 0);
+      for (int w = 0; w < 5; w++) {
+        objects[i]->words[w] = i;
+      }
+      memset(buffers[i], i, 100);
+    }
+    for (int i = 0; i < N; i++) {
+      for (int w = 0; w < 5; w++) {
+        assert(objects[i]->words[w] == (uint64_t) i);
+      }
+      assert(buffers[i][99] == (char) i);
+    }
+    qsort(objects, N, sizeof(Object *), by_address);
+    for (int i = 1; i < N; i++) {
+      assert((char *) objects[i - 1] + sizeof(Object) <= (char *) objects[i]);
+    }
+    for (int i = 0; i < N; i++) {
+      my_delete(objects[i]);
+      if (i % 2 == 0) {
+        my_free_inline(buffers[i], 100);
+      } else {
+        my_free(buffers[i]);
+      }
+    }
+  }
+  return NULL;
+}
+
+int main() {
+  pthread_t thread;
+  pthread_create(&thread, NULL, run, NULL);
+  pthread_join(thread, NULL);
+  run(NULL);
+  return 0;
+}
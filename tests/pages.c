@@ -0,0 +1,109 @@
+#include "testing.h"
+#include "../src/mypages.h"
+#include <unistd.h>
+
+/**
+ * This test checks the page heap under mymalloc: the page map finds the
+ * span of a huge block and a slab block, and nothing for a heap block,
+ * whose heap isn't made of spans, or for memory that isn't the allocator's;
+ * slabs whose blocks all come back return their pages to the page heap, and
+ * their pages make slabs of another size class from scratch; and
+ * the pages inside a large block that is freed are given back to the kernel
+ * while its heap stays mapped.
+ *
+ * Reason(s) you may fail this test:
+ * - A span isn't registered in the page map, or with the wrong kind.
+ * - An empty slab isn't returned to the page heap.
+ * - A reused span keeps the slab state of its last size class.
+ * - A large free block keeps its pages resident.
+ */
+
+#define N_OBJECTS 20000
+#define MEDIUM_SIZE (512 << 10)
+#define SMALL_SIZE 16
+#define OTHER_SIZE 256
+
+typedef struct {
+  char bytes[64];
+} Object;
+
+static void expect_kind(void *ptr, int kind, const char *what) {
+  Span *span = my_span_of(ptr);
+  if ((kind < 0 && span != NULL) || (kind >= 0 && (span == NULL || span->kind != kind))) {
+    fprintf(stderr, "Wrong span for %s\n", what);
+    exit(1);
+  }
+}
+
+int main() {
+  int local = 0;
+  void *small = mallocing(100);
+  void *huge = mallocing(4 << 20);
+  Object *object = my_new(Object);
+  expect_kind(small, -1, "a heap block");
+  expect_kind(huge, MY_SPAN_LARGE, "a huge block");
+  expect_kind(object, MY_SPAN_SLAB, "a slab block");
+  expect_kind(&local, -1, "the stack");
+  freeing(huge);
+  expect_kind(huge, -1, "an unmapped huge block");
+
+  static Object *objects[N_OBJECTS];
+  struct MyPageStats before, during, after;
+  my_pages_stats(&before);
+  for (int i = 0; i < N_OBJECTS; i++) {
+    objects[i] = my_new(Object);
+    CHECK_NULL(objects[i]);
+  }
+  my_pages_stats(&during);
+  for (int i = 0; i < N_OBJECTS; i++) {
+    freeing(objects[i]);
+  }
+  my_pages_stats(&after);
+  if (after.in_use >= during.in_use || during.in_use - after.in_use < (N_OBJECTS * sizeof(Object)) / 2) {
+    fprintf(stderr, "Empty slabs weren't returned: %zu bytes in use with %d objects, %zu after\n", during.in_use,
+            N_OBJECTS, after.in_use);
+    exit(1);
+  }
+
+  // The spans of freed 16 byte slabs come back as 256 byte slabs
+  static char *blocks[N_OBJECTS];
+  for (int i = 0; i < N_OBJECTS; i++) {
+    blocks[i] = my_malloc_inline(SMALL_SIZE);
+    CHECK_NULL(blocks[i]);
+  }
+  for (int i = 0; i < N_OBJECTS; i++) {
+    freeing(blocks[i]);
+  }
+  for (int i = 0; i < N_OBJECTS; i++) {
+    blocks[i] = my_malloc_inline(OTHER_SIZE);
+    CHECK_NULL(blocks[i]);
+    expect_kind(blocks[i], MY_SPAN_SLAB, "a reused slab block");
+    memset(blocks[i], (char) i, OTHER_SIZE);
+  }
+  for (int i = 0; i < N_OBJECTS; i++) {
+    assert(blocks[i][0] == (char) i && blocks[i][OTHER_SIZE - 1] == (char) i);
+    freeing(blocks[i]);
+  }
+
+  char *medium = mallocing(MEDIUM_SIZE);
+  void *guard = mallocing(100);
+  memset(medium, 1, MEDIUM_SIZE);
+  freeing(medium);
+  char *first = (char *) (((uintptr_t) medium + 2 * 4096) & ~(uintptr_t) 4095);
+  size_t length = MEDIUM_SIZE - 4 * 4096;
+  unsigned char resident[MEDIUM_SIZE / 4096];
+  if (mincore(first, length, resident) != 0) {
+    perror("mincore");
+    exit(1);
+  }
+  for (size_t page = 0; page < length / 4096; page++) {
+    if (resident[page] & 1) {
+      fprintf(stderr, "Page %zu of a freed %d byte block is still resident\n", page, MEDIUM_SIZE);
+      exit(1);
+    }
+  }
+  freeing(guard);
+  freeing(small);
+  my_delete(object);
+  return 0;
+}
@@ -0,0 +1,50 @@
+#include "testing.h"
+#include <stdint.h>
+
+/**
+ * This test allocates blocks with the placement flags of my_malloc_flags,
+ * interleaved with plain ones. Every placed payload must start on a cache
+ * line (or page) and no other block may reach into the lines it spans.
+ *
+ * Reason(s) you may fail this test:
+ * - my_malloc_flags doesn't align the payload.
+ * - A block is placed in the padding of a placed one.
+ */
+
+#define N 200
+#define LINE 64
+#define PAGE 4096
+
+static uintptr_t round_down(uintptr_t x, uintptr_t alignment) {
+  return x & ~(alignment - 1);
+}
+
+int main() {
+  char *placed[N], *plain[N];
+  size_t sizes[N];
+  for (int i = 0; i < N; i++) {
+    sizes[i] = 1 + i % 100;
+    placed[i] = my_malloc_flags(sizes[i], i % 10 == 0 ? MY_MALLOC_PAGE : MY_MALLOC_CACHE_LINE);
+    CHECK_NULL(placed[i]);
+    plain[i] = mallocing(8 + i % 24);
+    assert((uintptr_t) placed[i] % (i % 10 == 0 ? PAGE : LINE) == 0);
+  }
+  for (int i = 0; i < N; i++) {
+    uintptr_t first = (uintptr_t) placed[i];
+    uintptr_t last = round_down(first + sizes[i] - 1, LINE) + LINE;
+    for (int j = 0; j < N; j++) {
+      uintptr_t lo = (uintptr_t) ptr_to_block(plain[j]);
+      uintptr_t hi = (uintptr_t) plain[j] + 8 + j % 24;
+      assert(hi <= first || lo >= last);
+      if (j != i) {
+        lo = (uintptr_t) placed[j];
+        hi = lo + sizes[j];
+        assert(hi <= first || lo >= last);
+      }
+    }
+  }
+  for (int i = 0; i < N; i++) {
+    my_free(placed[i]);
+    my_free(plain[i]);
+  }
+}
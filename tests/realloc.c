@@ -0,0 +1,64 @@
+#include "testing.h"
+
+/**
+ * This test grows a block with my_realloc from a few bytes to 64 MB, past
+ * the size at which blocks get mappings of their own, and shrinks it back,
+ * checking the contents survive every step. It then checks realloc of NULL
+ * and to size 0.
+ *
+ * Reason(s) you may fail this test:
+ * - my_realloc doesn't copy the payload when it moves a block.
+ * - my_realloc loses the contents of a huge block when it remaps it.
+ * - my_free doesn't recognise huge blocks, or frees them twice.
+ */
+
+#define MAX_SIZE (64ull << 20)
+
+static void fill(unsigned char *ptr, size_t from, size_t to) {
+  for (size_t i = from; i < to; i++) {
+    ptr[i] = (unsigned char) (i * 31 + 7);
+  }
+}
+
+static void check(unsigned char *ptr, size_t size) {
+  // Every byte of small blocks, one per page of large ones
+  size_t step = size < 65536 ? 1 : 4093;
+  for (size_t i = 0; i < size; i += step) {
+    if (ptr[i] != (unsigned char) (i * 31 + 7)) {
+      fprintf(stderr, "Byte %zu lost after my_realloc to %zu bytes\n", i, size);
+      exit(1);
+    }
+  }
+}
+
+int main() {
+  size_t size = 8;
+  unsigned char *ptr = mallocing(size);
+  fill(ptr, 0, size);
+  // Something to move past
+  void *other = mallocing(8);
+  while (size < MAX_SIZE) {
+    size_t new_size = size * 2;
+    ptr = my_realloc(ptr, new_size);
+    CHECK_NULL(ptr);
+    check(ptr, size);
+    fill(ptr, size, new_size);
+    size = new_size;
+  }
+  while (size > 8) {
+    size /= 4;
+    ptr = my_realloc(ptr, size);
+    CHECK_NULL(ptr);
+    check(ptr, size);
+  }
+  freeing(ptr);
+  freeing(other);
+
+  ptr = my_realloc(NULL, 100);
+  CHECK_NULL(ptr);
+  if (my_realloc(ptr, 0) != NULL) {
+    fprintf(stderr, "Expected my_realloc to size 0 to return NULL\n");
+    exit(1);
+  }
+  return 0;
+}
@@ -0,0 +1,77 @@
+#include "testing.h"
+#include "../src/mytrace.h"
+#include <pthread.h>
+#include <string.h>
+
+/**
+ * This test traces allocations from two threads, dumps the trace and reads
+ * it back: every allocation and free must be there, in time order per
+ * thread, and freeing neighbouring blocks must record a coalesce.
+ *
+ * Reason(s) you may fail this test:
+ * - Events are lost or recorded while tracing is off.
+ * - The dump doesn't follow the format in mytrace.h.
+ */
+
+#define N 1000
+#define SIZE 48
+#define PATH "/tmp/mymalloc-trace-test.trace"
+
+static void *allocate_and_free(void *arg) {
+  void *ptrs[N];
+  for (int i = 0; i < N; i++) {
+    ptrs[i] = mallocing(SIZE);
+  }
+  for (int i = 0; i < N; i++) {
+    freeing(ptrs[i]);
+  }
+  return NULL;
+}
+
+int main() {
+  // Not recorded
+  freeing(mallocing(SIZE));
+
+  my_trace_enable(1);
+  pthread_t thread;
+  pthread_create(&thread, NULL, allocate_and_free, NULL);
+  pthread_join(thread, NULL);
+  allocate_and_free(NULL);
+  my_trace_enable(0);
+  freeing(mallocing(SIZE));
+  assert(my_trace_dump(PATH) == 0);
+
+  FILE *f = fopen(PATH, "rb");
+  assert(f != NULL);
+  MyTraceHeader header;
+  assert(fread(&header, sizeof(header), 1, f) == 1);
+  assert(memcmp(header.magic, MY_TRACE_MAGIC, 8) == 0);
+  assert(header.event_size == sizeof(MyTraceEvent));
+  assert(header.rings == 2);
+
+  for (uint32_t r = 0; r < header.rings; r++) {
+    MyTraceRing ring;
+    assert(fread(&ring, sizeof(ring), 1, f) == 1);
+    assert(ring.count == ring.recorded);
+    size_t allocs = 0, frees = 0, coalesces = 0;
+    uint64_t last = 0;
+    for (uint64_t i = 0; i < ring.count; i++) {
+      MyTraceEvent event;
+      assert(fread(&event, sizeof(event), 1, f) == 1);
+      assert(event.time_ns >= last);
+      last = event.time_ns;
+      if (event.type == MY_TRACE_ALLOC) {
+        assert(event.size == SIZE && event.arg >= SIZE);
+        allocs++;
+      } else if (event.type == MY_TRACE_FREE) {
+        frees++;
+      } else if (event.type == MY_TRACE_COALESCE) {
+        coalesces++;
+      }
+    }
+    assert(allocs == N && frees == N);
+    assert(coalesces > 0);
+  }
+  fclose(f);
+  remove(PATH);
+}
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+
+# Decodes an allocator event trace (src/mytrace.h) to text or JSON:
+#
+#   MYMALLOC_TRACE=1 MYMALLOC_TRACE_FILE=run.trace ./bench/latency
+#   ./tracedump.py run.trace | less
+#   ./tracedump.py run.trace --json -o run.json
+#
+# The events of all threads are merged in time order. Text lines give the
+# time since the first event in microseconds, the thread, the event and its
+# fields; JSON is a list of objects with the same fields, times in ns.
+
+import argparse
+import heapq
+import json
+import signal
+import struct
+import sys
+from typing import Iterator, List, Tuple
+
+MAGIC = b"MYTRACE1"
+HEADER = struct.Struct("=8sII")
+RING = struct.Struct("=IIQQ")
+EVENT = struct.Struct("=QQQII")
+
+# Event types and the name of their arg field
+EVENTS = {
+    1: ("alloc", "block"),
+    2: ("free", None),
+    3: ("split", "split_off"),
+    4: ("coalesce", "blocks"),
+    5: ("chunk_map", "node"),
+    6: ("cache_refill", "blocks"),
+}
+
+Event = Tuple[int, int, int, int, int, int]
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("trace", type=str, help="trace file")
+    parser.add_argument("--json", action="store_true",
+                        help="write JSON instead of text")
+    parser.add_argument("-t", "--type", type=str, action="append",
+                        help="only show events of this type, may be repeated")
+    parser.add_argument("-o", "--output", type=str, default="-",
+                        help="file to write, default to stdout")
+    return parser.parse_args()
+
+
+def read_trace(path: str) -> Tuple[List[List[Event]], List[str]]:
+    """Returns the events of each thread, as (time, tid, type, addr, size,
+    arg) tuples, and a note for each thread that lost events."""
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, event_size, rings = HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        sys.exit(f"{path} is not a mymalloc trace")
+    if event_size != EVENT.size:
+        sys.exit(f"{path} has {event_size} byte events, expected {EVENT.size}")
+    offset = HEADER.size
+    threads = []
+    notes = []
+    for _ in range(rings):
+        tid, capacity, recorded, count = RING.unpack_from(data, offset)
+        offset += RING.size
+        events = []
+        for _ in range(count):
+            time, addr, size, kind, arg = EVENT.unpack_from(data, offset)
+            offset += event_size
+            events.append((time, tid, kind, addr, size, arg))
+        threads.append(events)
+        if recorded > count:
+            notes.append(f"thread {tid}: {recorded - count} older events "
+                         f"overwritten (ring of {capacity})")
+    return threads, notes
+
+
+def merged(threads: List[List[Event]], types) -> Iterator[Event]:
+    for event in heapq.merge(*threads):
+        if types is None or EVENTS.get(event[2], ("?",))[0] in types:
+            yield event
+
+
+def as_dict(event: Event) -> dict:
+    time, tid, kind, addr, size, arg = event
+    name, arg_name = EVENTS.get(kind, (f"type{kind}", "arg"))
+    d = {"time_ns": time, "tid": tid, "event": name, "addr": hex(addr),
+         "size": size}
+    if arg_name is not None:
+        d[arg_name] = arg
+    return d
+
+
+def write_text(out, events: Iterator[Event], notes: List[str]):
+    for note in notes:
+        out.write(f"# {note}\n")
+    start = None
+    for event in events:
+        if start is None:
+            start = event[0]
+        d = as_dict(event)
+        fields = " ".join(f"{k}={v}" for k, v in d.items()
+                          if k not in ("time_ns", "tid", "event", "addr"))
+        out.write(f"{(d['time_ns'] - start) / 1000:14.3f} {d['tid']:>7} "
+                  f"{d['event']:<12} {d['addr']:>16} {fields}\n")
+
+
+def main():
+    # Quiet when piped into head
+    signal.signal(signal.SIGPIPE, signal.SIG_DFL)
+    args = parse_args()
+    threads, notes = read_trace(args.trace)
+    types = set(args.type) if args.type else None
+    out = sys.stdout if args.output == "-" else open(args.output, "w")
+    events = merged(threads, types)
+    if args.json:
+        json.dump([as_dict(e) for e in events], out, indent=1)
+        out.write("\n")
+        for note in notes:
+            print(note, file=sys.stderr)
+    else:
+        write_text(out, events, notes)
+    if out is not sys.stdout:
+        out.close()
+
+
+if __name__ == "__main__":
+    main()